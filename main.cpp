@@ -8,4 +8,4 @@ int main(int argc, char** argv)
     window.showFullScreen();
 
     return app.exec();
-}
\ No newline at end of file
+}
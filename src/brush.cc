@@ -0,0 +1,239 @@
+#include "brush.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <utility>
+
+#include "filters.hh"
+#include "image_operations.hh"
+#include "scheduler.hh"
+
+namespace tifo
+{
+    namespace
+    {
+        float blur_sigma(int amount)
+        {
+            return 0.5f + std::abs(amount) / 20.0f;
+        }
+
+        int blur_size(int amount)
+        {
+            return 2 * (int)std::ceil(2 * blur_sigma(amount)) + 1;
+        }
+
+        // The existing point ops and Gaussian blur, applied to a whole tile
+        void apply_effect(rgb24_image& image, const brush_stroke& stroke)
+        {
+            int amount = std::clamp(stroke.amount, -100, 100);
+
+            switch (stroke.effect)
+            {
+            case brush_effect::dodge:
+            case brush_effect::burn: {
+                int shift = stroke.effect == brush_effect::dodge
+                    ? std::abs(amount)
+                    : -std::abs(amount);
+                for (int channel : { RED, GREEN, BLUE })
+                    increase_channel(image, shift, channel);
+                break;
+            }
+            case brush_effect::saturation:
+                rgb_saturation(image, amount);
+                break;
+            case brush_effect::contrast:
+                increase_contrast(image, 100 + amount);
+                break;
+            case brush_effect::blur:
+                rgb_gaussian(image, blur_size(amount), blur_sigma(amount));
+                break;
+            }
+        }
+
+        // Squared distance from p to the segment [a, b]
+        float distance2(const outline_point& p, const outline_point& a,
+                        const outline_point& b)
+        {
+            float dx = b.x - a.x;
+            float dy = b.y - a.y;
+            float length2 = dx * dx + dy * dy;
+            float t = length2 > 0
+                ? std::clamp(((p.x - a.x) * dx + (p.y - a.y) * dy) / length2,
+                             0.0f, 1.0f)
+                : 0.0f;
+
+            float ex = a.x + t * dx - p.x;
+            float ey = a.y + t * dy - p.y;
+            return ex * ex + ey * ey;
+        }
+
+        // Start of the segment ending at point i
+        const outline_point& segment_start(const brush_stroke& stroke,
+                                           std::size_t i)
+        {
+            return stroke.points[i == 0 ? 0 : i - 1];
+        }
+    } // namespace
+
+    image_rect brush_stroke::segment_bounds(std::size_t i) const
+    {
+        auto& a = segment_start(*this, i);
+        auto& b = points[i];
+
+        return { (int)std::floor(std::min(a.x, b.x) - radius),
+                 (int)std::floor(std::min(a.y, b.y) - radius),
+                 (int)std::ceil(std::max(a.x, b.x) + radius),
+                 (int)std::ceil(std::max(a.y, b.y) + radius) };
+    }
+
+    int brush_stroke::halo() const
+    {
+        return effect == brush_effect::blur ? blur_size(amount) / 2 : 0;
+    }
+
+    brush_stroke brush_stroke::at_level(int n) const
+    {
+        float scale = 1.0f / (1 << n);
+
+        brush_stroke result = *this;
+        result.radius = std::max(radius * scale, 0.5f);
+        for (auto& point : result.points)
+        {
+            point.x *= scale;
+            point.y *= scale;
+        }
+
+        return result;
+    }
+
+    std::vector<image_rect> stroke_tiles(const brush_stroke& stroke, int sx,
+                                         int sy, std::size_t first)
+    {
+        constexpr int size = brush_tile_size;
+        // Distance from the center of a tile to its corners
+        const float half_diagonal = size * 0.7072f;
+
+        std::set<std::pair<int, int>> touched;
+        for (std::size_t i = first; i < stroke.points.size(); i++)
+        {
+            auto rect = stroke.segment_bounds(i).intersected({ 0, 0, sx, sy });
+            if (rect.empty())
+                continue;
+
+            // Only the tiles close enough to the segment, not its whole box
+            float reach = stroke.radius + half_diagonal;
+            for (int ty = rect.y0 / size; ty <= (rect.y1 - 1) / size; ty++)
+            {
+                for (int tx = rect.x0 / size; tx <= (rect.x1 - 1) / size; tx++)
+                {
+                    outline_point center{ (tx + 0.5f) * size,
+                                          (ty + 0.5f) * size };
+                    if (distance2(center, segment_start(stroke, i),
+                                  stroke.points[i])
+                        <= reach * reach)
+                        touched.insert({ ty, tx });
+                }
+            }
+        }
+
+        std::vector<image_rect> tiles;
+        for (auto [ty, tx] : touched)
+            tiles.push_back(image_rect{ tx * size, ty * size, (tx + 1) * size,
+                                        (ty + 1) * size }
+                                .intersected({ 0, 0, sx, sy }));
+
+        return tiles;
+    }
+
+    void render_stroke(const rgb24_image& source, rgb24_image& target,
+                       const brush_stroke& stroke,
+                       const std::vector<image_rect>& tiles)
+    {
+        image_rect full{ 0, 0, source.sx, source.sy };
+        int halo = stroke.halo();
+        float inner = stroke.radius * std::clamp(stroke.hardness, 0.0f, 1.0f);
+        float fade = std::max(stroke.radius - inner, 1e-3f);
+
+        parallel_rows(tiles.size(), [&](int begin, int end) {
+            std::vector<std::size_t> segments;
+
+            for (int t = begin; t < end; t++)
+            {
+                auto& tile = tiles[t];
+
+                segments.clear();
+                for (std::size_t i = 0; i < stroke.points.size(); i++)
+                {
+                    if (!stroke.segment_bounds(i).intersected(tile).empty())
+                        segments.push_back(i);
+                }
+                if (segments.empty())
+                    continue;
+
+                auto area = tile.expanded(halo).intersected(full);
+                auto adjusted = crop(source, area);
+                try
+                {
+                    apply_effect(*adjusted, stroke);
+                }
+                catch (...)
+                {
+                    delete adjusted;
+                    throw;
+                }
+
+                for (int y = tile.y0; y < tile.y1; y++)
+                {
+                    const uint8_t* in = source.pixels + y * source.sx * 3;
+                    const uint8_t* effect = adjusted->pixels
+                        + (y - area.y0) * adjusted->sx * 3;
+                    uint8_t* out = target.pixels + y * target.sx * 3;
+
+                    for (int x = tile.x0; x < tile.x1; x++)
+                    {
+                        outline_point p{ x + 0.5f, y + 0.5f };
+                        float d2 = stroke.radius * stroke.radius;
+                        for (auto i : segments)
+                            d2 = std::min(d2,
+                                          distance2(p, segment_start(stroke, i),
+                                                    stroke.points[i]));
+
+                        float d = std::sqrt(d2);
+                        float weight =
+                            std::clamp((stroke.radius - d) / fade, 0.0f, 1.0f);
+                        // Smooth edge rather than a linear ramp
+                        weight = weight * weight * (3 - 2 * weight);
+
+                        const uint8_t* e = effect + (x - area.x0) * 3;
+                        for (int c = 0; c < 3; c++)
+                            out[x * 3 + c] = std::lround(
+                                in[x * 3 + c]
+                                + (e[c] - in[x * 3 + c]) * weight);
+                    }
+                }
+
+                delete adjusted;
+            }
+        });
+    }
+
+    rgb24_image* apply_stroke(const rgb24_image& image,
+                              const brush_stroke& stroke)
+    {
+        auto result = new rgb24_image(image);
+
+        try
+        {
+            render_stroke(image, *result, stroke,
+                          stroke_tiles(stroke, image.sx, image.sy));
+        }
+        catch (...)
+        {
+            delete result;
+            throw;
+        }
+
+        return result;
+    }
+} // namespace tifo
@@ -0,0 +1,78 @@
+#ifndef TIFO_PROJECT_BRUSH_HH
+#define TIFO_PROJECT_BRUSH_HH
+
+#include <cstddef>
+#include <vector>
+
+#include "image.hh"
+#include "region.hh"
+#include "selection.hh"
+
+namespace tifo
+{
+    enum class brush_effect
+    {
+        dodge,
+        burn,
+        saturation,
+        contrast,
+        blur,
+    };
+
+    /**
+     * Local adjustment painted along a path of points, in pixels of the
+     * image. The effect is fully applied up to hardness * radius from the
+     * path, then fades out until radius. A stroke does not build up where
+     * it crosses itself.
+     */
+    struct brush_stroke
+    {
+        brush_effect effect = brush_effect::dodge;
+        /**
+         * Strength of the effect, from -100 to 100. Dodge, burn and blur
+         * only use its magnitude.
+         */
+        int amount = 50;
+        float radius = 20;
+        float hardness = 0.5f;
+        std::vector<outline_point> points;
+
+        /**
+         * Pixels touched by the segment ending at point i, or by the dab
+         * alone for the first point.
+         */
+        image_rect segment_bounds(std::size_t i) const;
+
+        /** Pixels read around the ones computed by the effect. */
+        int halo() const;
+
+        /** Same stroke on pyramid level n. */
+        brush_stroke at_level(int n) const;
+    };
+
+    /** Size of the tiles a stroke is rendered by. */
+    constexpr int brush_tile_size = 64;
+
+    /**
+     * Tiles of an sx x sy image touched by the segments of the stroke from
+     * point first on, in pixels.
+     */
+    std::vector<image_rect> stroke_tiles(const brush_stroke& stroke, int sx,
+                                         int sy, std::size_t first = 0);
+
+    /**
+     * Renders the stroke over the given tiles of source into target, an
+     * image of the same size; the other pixels of target are left alone.
+     * Each tile is processed with the halo of the effect, so the cost only
+     * depends on the area painted.
+     */
+    void render_stroke(const rgb24_image& source, rgb24_image& target,
+                       const brush_stroke& stroke,
+                       const std::vector<image_rect>& tiles);
+
+    /** Copy of the image with the whole stroke rendered. */
+    rgb24_image* apply_stroke(const rgb24_image& image,
+                              const brush_stroke& stroke);
+} // namespace tifo
+
+#endif //TIFO_PROJECT_BRUSH_HH
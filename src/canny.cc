@@ -0,0 +1,326 @@
+#include "canny.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "scheduler.hh"
+
+namespace tifo
+{
+    namespace
+    {
+        // Blur weights are in 1/256
+        constexpr int weight_one = 256;
+
+        // Labels of the pixels between suppression and hysteresis
+        constexpr uint8_t not_edge = 0;
+        constexpr uint8_t weak = 128;
+        constexpr uint8_t strong = 255;
+
+        // Sectors of the gradient direction, named after the axis along
+        // which the neighbours are compared
+        enum sector : uint8_t
+        {
+            horizontal_sector,
+            // Gradient along x = y, y pointing down
+            diagonal_sector,
+            vertical_sector,
+            // Gradient along x = -y
+            antidiagonal_sector,
+        };
+
+        // Weights of the half of a normalized Gaussian kernel from its
+        // center, summing to weight_one over the whole kernel
+        std::vector<int> gaussian_weights(float sigma)
+        {
+            int radius = std::max(1, (int)std::ceil(3 * sigma));
+            std::vector<double> exact(radius + 1);
+            double total = 0;
+            for (int i = 0; i <= radius; i++)
+            {
+                exact[i] = std::exp(-i * i / (2.0 * sigma * sigma));
+                total += i == 0 ? exact[i] : 2 * exact[i];
+            }
+
+            std::vector<int> weights(radius + 1);
+            int sum = 0;
+            for (int i = radius; i >= 1; i--)
+            {
+                weights[i] = std::lround(exact[i] / total * weight_one);
+                sum += 2 * weights[i];
+            }
+            weights[0] = weight_one - sum;
+            return weights;
+        }
+
+        void blur(const uint8_t* image, int sx, int sy, float sigma,
+                  canny_workspace& workspace)
+        {
+            uint8_t* blurred = workspace.blurred.data();
+
+            if (sigma <= 0)
+            {
+                std::memcpy(blurred, image, (std::size_t)sx * sy);
+                return;
+            }
+
+            auto weights = gaussian_weights(sigma);
+            int radius = weights.size() - 1;
+            uint16_t* horizontal = workspace.horizontal.data();
+
+            parallel_rows(sy, [&](int begin, int end) {
+                for (int y = begin; y < end; y++)
+                {
+                    const uint8_t* in = image + y * sx;
+                    uint16_t* out = horizontal + y * sx;
+                    for (int x = 0; x < sx; x++)
+                    {
+                        int sum = in[x] * weights[0];
+                        for (int i = 1; i <= radius; i++)
+                            sum += (in[std::max(x - i, 0)]
+                                    + in[std::min(x + i, sx - 1)])
+                                * weights[i];
+                        out[x] = sum;
+                    }
+                }
+            });
+
+            // Whole rows at once, so that the columns are summed in vectors,
+            // in the magnitude buffer which is not used yet
+            parallel_rows(sy, [&](int begin, int end) {
+                for (int y = begin; y < end; y++)
+                {
+                    int32_t* sums = workspace.magnitude.data() + y * sx;
+                    const uint16_t* center = horizontal + y * sx;
+                    for (int x = 0; x < sx; x++)
+                        sums[x] = center[x] * weights[0];
+
+                    for (int i = 1; i <= radius; i++)
+                    {
+                        const uint16_t* above =
+                            horizontal + std::max(y - i, 0) * sx;
+                        const uint16_t* below =
+                            horizontal + std::min(y + i, sy - 1) * sx;
+                        for (int x = 0; x < sx; x++)
+                            sums[x] += (above[x] + below[x]) * weights[i];
+                    }
+
+                    uint8_t* out = blurred + y * sx;
+                    for (int x = 0; x < sx; x++)
+                        out[x] = (sums[x] + weight_one * weight_one / 2)
+                            / (weight_one * weight_one);
+                }
+            });
+        }
+
+        // Sobel gradient of each pixel: its squared magnitude and sector
+        void gradient(int sx, int sy, canny_workspace& workspace)
+        {
+            const uint8_t* blurred = workspace.blurred.data();
+            int32_t* magnitude = workspace.magnitude.data();
+            uint8_t* direction = workspace.direction.data();
+
+            parallel_rows(sy, [&](int begin, int end) {
+                for (int y = begin; y < end; y++)
+                {
+                    const uint8_t* above = blurred + std::max(y - 1, 0) * sx;
+                    const uint8_t* row = blurred + y * sx;
+                    const uint8_t* below =
+                        blurred + std::min(y + 1, sy - 1) * sx;
+
+                    for (int x = 0; x < sx; x++)
+                    {
+                        int left = std::max(x - 1, 0);
+                        int right = std::min(x + 1, sx - 1);
+
+                        int gx = above[right] - above[left]
+                            + 2 * (row[right] - row[left]) + below[right]
+                            - below[left];
+                        int gy = below[left] - above[left]
+                            + 2 * (below[x] - above[x]) + below[right]
+                            - above[right];
+                        magnitude[y * sx + x] = gx * gx + gy * gy;
+
+                        // tan(22.5) = 0.414 and tan(67.5) = 2.414
+                        int ax = std::abs(gx);
+                        int ay = std::abs(gy);
+                        uint8_t sector;
+                        if (ay * 1000 <= ax * 414)
+                            sector = horizontal_sector;
+                        else if (ay * 1000 >= ax * 2414)
+                            sector = vertical_sector;
+                        else if ((gx < 0) == (gy < 0))
+                            sector = diagonal_sector;
+                        else
+                            sector = antidiagonal_sector;
+                        direction[y * sx + x] = sector;
+                    }
+                }
+            });
+        }
+
+        // Keeps the pixels whose magnitude is a maximum across their edge,
+        // labelled weak or strong, the border being left out
+        void suppress(int sx, int sy, int low, int high, uint8_t* edges,
+                      const canny_workspace& workspace)
+        {
+            const int32_t* magnitude = workspace.magnitude.data();
+            const uint8_t* direction = workspace.direction.data();
+            long low_squared = (long)low * low;
+            long high_squared = (long)high * high;
+
+            // Offsets of the two neighbours compared in each sector
+            const int offsets[4] = { 1, sx + 1, sx, sx - 1 };
+
+            parallel_rows(sy, [&](int begin, int end) {
+                for (int y = begin; y < end; y++)
+                {
+                    uint8_t* out = edges + y * sx;
+                    if (y == 0 || y == sy - 1)
+                    {
+                        std::memset(out, not_edge, sx);
+                        continue;
+                    }
+
+                    out[0] = not_edge;
+                    out[sx - 1] = not_edge;
+                    for (int x = 1; x < sx - 1; x++)
+                    {
+                        int i = y * sx + x;
+                        int offset = offsets[direction[i]];
+                        int32_t m = magnitude[i];
+
+                        // Ties go to the pixel before along the direction
+                        bool maximum = m > magnitude[i - offset]
+                            && m >= magnitude[i + offset];
+                        out[x] = !maximum || m < low_squared ? not_edge
+                            : m >= high_squared              ? strong
+                                                             : weak;
+                    }
+                }
+            });
+        }
+
+        // Turns the weak pixels connected to strong ones strong, and drops
+        // the others
+        void hysteresis(int sx, int sy, uint8_t* labels,
+                        canny_workspace& workspace)
+        {
+            auto& stack = workspace.stack;
+            stack.clear();
+
+            for (int i = 0; i < sx * sy; i++)
+            {
+                if (labels[i] == strong)
+                    stack.push_back(i);
+            }
+
+            // The border is not an edge, so the neighbours of a labelled
+            // pixel are always inside the image
+            const int neighbours[8] = { -sx - 1, -sx, -sx + 1, -1,
+                                        1,       sx - 1, sx,   sx + 1 };
+            while (!stack.empty())
+            {
+                int i = stack.back();
+                stack.pop_back();
+                for (int offset : neighbours)
+                {
+                    if (labels[i + offset] == weak)
+                    {
+                        labels[i + offset] = strong;
+                        stack.push_back(i + offset);
+                    }
+                }
+            }
+
+            parallel_rows(sy, [&](int begin, int end) {
+                uint8_t* row = labels + begin * sx;
+                for (int i = 0; i < (end - begin) * sx; i++)
+                    row[i] = row[i] == strong ? strong : not_edge;
+            });
+        }
+
+        // canny on planes of sx x sy levels, edges possibly being image
+        void detect(const uint8_t* image, uint8_t* edges, int sx, int sy,
+                    float sigma, int low, int high,
+                    canny_workspace& workspace)
+        {
+            std::size_t pixels = (std::size_t)sx * sy;
+            if (pixels == 0)
+                return;
+
+            workspace.horizontal.resize(pixels);
+            workspace.blurred.resize(pixels);
+            workspace.magnitude.resize(pixels);
+            workspace.direction.resize(pixels);
+
+            blur(image, sx, sy, sigma, workspace);
+            gradient(sx, sy, workspace);
+            suppress(sx, sy, low, high, edges, workspace);
+            hysteresis(sx, sy, edges, workspace);
+        }
+    } // namespace
+
+    void canny(const gray8_image& image, gray8_image& edges, float sigma,
+               int low, int high, canny_workspace& workspace)
+    {
+        if (edges.sx != image.sx || edges.sy != image.sy)
+            throw std::invalid_argument("Edges of another size");
+
+        detect(image.pixels, edges.pixels, image.sx, image.sy, sigma, low,
+               high, workspace);
+    }
+
+    gray8_image* canny(const gray8_image& image, float sigma, int low,
+                       int high)
+    {
+        canny_workspace workspace;
+
+        auto edges = new gray8_image(image.sx, image.sy);
+        try
+        {
+            canny(image, *edges, sigma, low, high, workspace);
+        }
+        catch (...)
+        {
+            delete edges;
+            throw;
+        }
+        return edges;
+    }
+
+    void canny_gray(rgb24_image& image, float sigma, int low, int high,
+                    canny_workspace& workspace)
+    {
+        auto& gray = workspace.gray;
+        gray.resize((std::size_t)image.sx * image.sy);
+
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin * image.sx; i < end * image.sx; i++)
+                gray[i] = (image.pixels[i * 3] + image.pixels[i * 3 + 1]
+                           + image.pixels[i * 3 + 2])
+                    / 3;
+        });
+
+        detect(gray.data(), gray.data(), image.sx, image.sy, sigma, low, high,
+               workspace);
+
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin * image.sx; i < end * image.sx; i++)
+            {
+                image.pixels[i * 3] = gray[i];
+                image.pixels[i * 3 + 1] = gray[i];
+                image.pixels[i * 3 + 2] = gray[i];
+            }
+        });
+    }
+
+    void canny_gray(rgb24_image& image, float sigma, int low, int high)
+    {
+        canny_workspace workspace;
+        canny_gray(image, sigma, low, high, workspace);
+    }
+} // namespace tifo
@@ -0,0 +1,56 @@
+#ifndef TIFO_PROJECT_CANNY_HH
+#define TIFO_PROJECT_CANNY_HH
+
+#include <cstdint>
+#include <vector>
+
+#include "image.hh"
+
+namespace tifo
+{
+    /**
+     * Buffers of the stages of canny, about 9 bytes per pixel. A caller
+     * running canny repeatedly keeps one, so that images of the same size
+     * or smaller allocate nothing; it holds its memory until destroyed.
+     */
+    struct canny_workspace
+    {
+        /** Gray level plane of canny_gray, then its edges. */
+        std::vector<uint8_t> gray;
+        /** Horizontal pass of the blur, in 1/256 of a level. */
+        std::vector<uint16_t> horizontal;
+        std::vector<uint8_t> blurred;
+        /** Squared gradient magnitude. */
+        std::vector<int32_t> magnitude;
+        /** Gradient direction, in four sectors of 45 degrees. */
+        std::vector<uint8_t> direction;
+        /** Pixels left to visit by the hysteresis. */
+        std::vector<int> stack;
+    };
+
+    /**
+     * Canny edge detector: Gaussian blur of the given sigma (none when it
+     * is not positive), Sobel gradient with its direction in the same pass,
+     * non-maximum suppression across the edges, then hysteresis: the local
+     * maxima with a gradient magnitude of at least high are edges, and so
+     * are the ones of at least low connected to them. A step from 0 to 255
+     * has a magnitude of 1020.
+     *
+     * edges gets 255 on the edges and 0 elsewhere. It must have the size of
+     * the image, and may be the image itself. The borders are repeated.
+     */
+    void canny(const gray8_image& image, gray8_image& edges, float sigma,
+               int low, int high, canny_workspace& workspace);
+
+    /** canny into a new mask, with a workspace freed on return. */
+    gray8_image* canny(const gray8_image& image, float sigma, int low,
+                       int high);
+
+    /** Edges of the gray level (R+G+B)/3, on the three channels. */
+    void canny_gray(rgb24_image& image, float sigma, int low, int high,
+                    canny_workspace& workspace);
+    /** canny_gray with a workspace freed on return. */
+    void canny_gray(rgb24_image& image, float sigma, int low, int high);
+} // namespace tifo
+
+#endif //TIFO_PROJECT_CANNY_HH
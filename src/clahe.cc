@@ -0,0 +1,185 @@
+#include "clahe.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "histogram.hh"
+#include "histogram_operations.hh"
+#include "region.hh"
+#include "scheduler.hh"
+
+namespace tifo
+{
+    namespace
+    {
+        // Weights of the interpolation are in 1/256
+        constexpr int weight_one = 256;
+
+        // Tiles interpolated at a pixel along one axis
+        struct neighbours
+        {
+            int first;
+            int second;
+            /** Weight of the second one. */
+            int weight;
+        };
+
+        // For each position along an axis of size pixels cut in count
+        // tiles of the given size
+        std::vector<neighbours> axis_neighbours(int size, int count,
+                                                int tile)
+        {
+            std::vector<neighbours> result(size);
+            for (int i = 0; i < size; i++)
+            {
+                // Position in tiles from the center of the first one
+                float position = (i + 0.5f) / tile - 0.5f;
+                int first = std::clamp((int)std::floor(position), 0,
+                                       count - 1);
+                int second = std::min(first + 1, count - 1);
+                float t = std::clamp(position - first, 0.0f, 1.0f);
+
+                result[i] = { first, second,
+                              (int)std::lround(t * weight_one) };
+            }
+            return result;
+        }
+
+        // Histogram of the gray levels of the part of the tile inside the
+        // image, counted by the band it falls to rather than by a nested
+        // parallel_rows, which would run inline
+        histogram_1d tile_histogram(const rgb24_image& image,
+                                    const image_rect& area)
+        {
+            // Consecutive pixels go to interleaved counts, so that runs of
+            // one level do not wait on their own increments
+            constexpr int copies = 4;
+            std::vector<unsigned int> counts(copies * IMAGE_NB_LEVELS);
+            for (int y = area.y0; y < area.y1; y++)
+            {
+                const uint8_t* pixel =
+                    image.pixels + (y * image.sx + area.x0) * 3;
+                for (int x = 0; x < area.x1 - area.x0; x++, pixel += 3)
+                    counts[(x % copies) * IMAGE_NB_LEVELS
+                           + (pixel[0] + pixel[1] + pixel[2]) / 3]++;
+            }
+
+            histogram_1d hist;
+            for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+            {
+                hist.histogram[level] = 0;
+                for (int copy = 0; copy < copies; copy++)
+                    hist.histogram[level] +=
+                        counts[copy * IMAGE_NB_LEVELS + level];
+            }
+            return hist;
+        }
+
+        // Caps the levels above limit and spreads the excess evenly
+        void clip_histogram(histogram_1d& hist, unsigned int limit)
+        {
+            unsigned long excess = 0;
+            for (auto& count : hist.histogram)
+            {
+                if (count > limit)
+                {
+                    excess += count - limit;
+                    count = limit;
+                }
+            }
+
+            unsigned long share = excess / IMAGE_NB_LEVELS;
+            unsigned long rest = excess % IMAGE_NB_LEVELS;
+            for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+                hist.histogram[level] += share;
+
+            // What remains goes to levels spread over the whole range
+            if (rest > 0)
+            {
+                unsigned long step = IMAGE_NB_LEVELS / rest;
+                for (unsigned long i = 0; i < rest; i++)
+                    hist.histogram[i * step]++;
+            }
+        }
+    } // namespace
+
+    void clahe(rgb24_image& image, int tiles, float clip_limit)
+    {
+        if (tiles < 1)
+            throw std::invalid_argument("CLAHE needs at least one tile");
+
+        int count_x = std::min(tiles, image.sx);
+        int count_y = std::min(tiles, image.sy);
+        int tile_x = (image.sx + count_x - 1) / count_x;
+        int tile_y = (image.sy + count_y - 1) / count_y;
+        // Rounding the tile size up can leave the last tiles empty
+        count_x = (image.sx + tile_x - 1) / tile_x;
+        count_y = (image.sy + tile_y - 1) / tile_y;
+
+        std::vector<level_table> tables(count_x * count_y);
+        parallel_rows(count_x * count_y, [&](int begin, int end) {
+            for (int t = begin; t < end; t++)
+            {
+                int tx = t % count_x;
+                int ty = t / count_x;
+                image_rect tile{ tx * tile_x, ty * tile_y,
+                                 (tx + 1) * tile_x, (ty + 1) * tile_y };
+                auto area = tile.intersected({ 0, 0, image.sx, image.sy });
+
+                auto hist = tile_histogram(image, area);
+                unsigned int limit = std::max(
+                    1.0f, clip_limit * area.area() / IMAGE_NB_LEVELS);
+                clip_histogram(hist, limit);
+                tables[t] = equalize_table(hist, IMAGE_MAX_LEVEL);
+            }
+        });
+
+        auto columns = axis_neighbours(image.sx, count_x, tile_x);
+        auto rows = axis_neighbours(image.sy, count_y, tile_y);
+
+        // Interpolated levels are in 1/weight_one^2, given in 1/luma_one
+        constexpr int luma_scale = weight_one * weight_one / luma_one;
+
+        parallel_rows(image.sy, [&](int begin, int end) {
+            std::vector<uint16_t> lumas(image.sx);
+            // Curves of the row of tiles around the current row of pixels,
+            // interpolated between the two rows of tile centers once for
+            // the whole row, in 1/weight_one
+            std::vector<uint16_t> curves(count_x * IMAGE_NB_LEVELS);
+
+            for (int y = begin; y < end; y++)
+            {
+                auto& row = rows[y];
+                const level_table* top = &tables[row.first * count_x];
+                const level_table* bottom = &tables[row.second * count_x];
+                for (int tx = 0; tx < count_x; tx++)
+                {
+                    uint16_t* curve = &curves[tx * IMAGE_NB_LEVELS];
+                    for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+                        curve[level] =
+                            top[tx][level] * (weight_one - row.weight)
+                            + bottom[tx][level] * row.weight;
+                }
+
+                uint8_t* pixels = image.pixels + y * image.sx * 3;
+                for (int x = 0; x < image.sx; x++)
+                {
+                    auto& column = columns[x];
+                    const uint16_t* left =
+                        &curves[column.first * IMAGE_NB_LEVELS];
+                    const uint16_t* right =
+                        &curves[column.second * IMAGE_NB_LEVELS];
+
+                    const uint8_t* pixel = pixels + x * 3;
+                    int v = (pixel[0] + pixel[1] + pixel[2]) / 3;
+                    lumas[x] = (left[v] * (weight_one - column.weight)
+                                + right[v] * column.weight + luma_scale / 2)
+                        / luma_scale;
+                }
+                set_luma_pixels(pixels, lumas.data(), image.sx);
+            }
+        });
+    }
+} // namespace tifo
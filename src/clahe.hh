@@ -0,0 +1,19 @@
+#ifndef TIFO_PROJECT_CLAHE_HH
+#define TIFO_PROJECT_CLAHE_HH
+
+#include "image.hh"
+
+namespace tifo
+{
+    /**
+     * Contrast limited adaptive histogram equalization. The image is cut
+     * in a grid of tiles x tiles, each equalized from the histogram of its
+     * gray levels, clipped at clip_limit times the mean count of a level
+     * with the excess spread over all the levels. The curves of the four
+     * nearest tile centers are interpolated at the gray level of each
+     * pixel, which set_luma_pixels then gives it, keeping its hue.
+     */
+    void clahe(rgb24_image& image, int tiles, float clip_limit);
+} // namespace tifo
+
+#endif //TIFO_PROJECT_CLAHE_HH
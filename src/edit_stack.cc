@@ -0,0 +1,283 @@
+#include "edit_stack.hh"
+
+#include <chrono>
+
+#include "scheduler.hh"
+
+namespace tifo
+{
+    rgb24_image* edit_replay::run()
+    {
+        std::shared_ptr<const rgb24_image> state = source;
+
+        if (backward)
+        {
+            for (std::size_t i = steps.size(); i-- > 0;)
+            {
+                check_cancelled();
+                if (steps[i].enabled)
+                    state.reset(steps[i].inverse(*state));
+            }
+
+            return new rgb24_image(*state);
+        }
+
+        rgb24_image* result = nullptr;
+        double pending = 0;
+
+        for (std::size_t i = 0; i < steps.size(); i++)
+        {
+            check_cancelled();
+
+            bool last = i + 1 == steps.size();
+            double cost = 0;
+
+            if (steps[i].enabled)
+            {
+                auto start = std::chrono::steady_clock::now();
+                auto output = steps[i].operation(*state);
+                cost = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+
+                if (last)
+                    result = output;
+                else
+                    state.reset(output);
+            }
+
+            costs.push_back(cost);
+            pending += cost;
+
+            if (!last)
+            {
+                if (pending >= cache_interval)
+                {
+                    states.push_back(state);
+                    pending = 0;
+                }
+                else
+                {
+                    states.push_back(nullptr);
+                }
+            }
+        }
+
+        if (!result)
+            result = new rgb24_image(*state);
+
+        return result;
+    }
+
+    edit_stack::edit_stack(std::size_t budget_bytes, double cache_interval_ms)
+        : states(budget_bytes)
+        , cache_interval(cache_interval_ms)
+    {}
+
+    void edit_stack::reset(std::shared_ptr<const rgb24_image> original)
+    {
+        states.clear();
+        steps.clear();
+        states.push(std::move(original));
+        current = 0;
+        generation++;
+    }
+
+    std::size_t edit_stack::size() const
+    {
+        return states.size();
+    }
+
+    bool edit_stack::empty() const
+    {
+        return states.empty();
+    }
+
+    std::uint64_t edit_stack::id(std::size_t state) const
+    {
+        return states.id(state);
+    }
+
+    bool edit_stack::contains(std::size_t state) const
+    {
+        return states.contains(state);
+    }
+
+    std::shared_ptr<const rgb24_image> edit_stack::get(std::size_t state)
+    {
+        return states.get(state);
+    }
+
+    const edit_step& edit_stack::step(std::size_t i) const
+    {
+        return steps[i];
+    }
+
+    void edit_stack::apply(std::size_t state, edit_step step,
+                           std::shared_ptr<const rgb24_image> result,
+                           std::optional<image_rect> changed)
+    {
+        truncate(state + 1);
+
+        steps.push_back(std::move(step));
+        states.push(std::move(result), changed);
+        generation++;
+
+        set_current(state + 1);
+    }
+
+    void edit_stack::set_enabled(std::size_t i, bool enabled)
+    {
+        if (steps[i].enabled == enabled)
+            return;
+
+        steps[i].enabled = enabled;
+        forget_after(i);
+    }
+
+    void edit_stack::replace(std::size_t i, std::string name,
+                             edit_operation operation, edit_operation inverse)
+    {
+        steps[i].name = std::move(name);
+        steps[i].operation = std::move(operation);
+        steps[i].inverse = std::move(inverse);
+        forget_after(i);
+    }
+
+    void edit_stack::truncate(std::size_t count)
+    {
+        if (count >= states.size())
+            return;
+
+        states.truncate(count);
+        steps.resize(count - 1);
+        if (current >= count)
+            current = count - 1;
+        generation++;
+    }
+
+    void edit_stack::set_current(std::size_t state)
+    {
+        current = state;
+        drop_cheap_states();
+    }
+
+    std::shared_ptr<edit_replay> edit_stack::prepare_replay(std::size_t state)
+    {
+        auto replay = std::make_shared<edit_replay>();
+        replay->generation = generation;
+        replay->cache_interval = cache_interval;
+
+        std::size_t from = state;
+        double forward = 0;
+        while (!states.contains(from))
+        {
+            from--;
+            if (steps[from].enabled)
+                forward += steps[from].cost_ms;
+        }
+
+        // Undoing invertible steps from a later stored state
+        std::size_t to = state;
+        double backward = 0;
+        while (to < steps.size()
+               && (!steps[to].enabled || steps[to].inverse))
+        {
+            if (steps[to].enabled)
+                backward += steps[to].cost_ms;
+            to++;
+            if (states.contains(to))
+                break;
+        }
+
+        if (to != state && states.contains(to) && backward < forward)
+        {
+            replay->from = state;
+            replay->to = to;
+            replay->backward = true;
+            replay->source = states.get(to);
+            replay->steps.assign(steps.begin() + state, steps.begin() + to);
+            return replay;
+        }
+
+        replay->from = from;
+        replay->to = state;
+        replay->source = states.get(from);
+        replay->steps.assign(steps.begin() + from, steps.begin() + state);
+
+        return replay;
+    }
+
+    bool edit_stack::finish_replay(const edit_replay& replay,
+                                   std::shared_ptr<const rgb24_image> result)
+    {
+        if (replay.generation != generation)
+            return false;
+
+        if (replay.backward)
+        {
+            states.restore(replay.from, std::move(result));
+            drop_cheap_states();
+            return true;
+        }
+
+        for (std::size_t i = 0; i < replay.costs.size(); i++)
+        {
+            if (replay.steps[i].enabled)
+                steps[replay.from + i].cost_ms = replay.costs[i];
+        }
+
+        for (std::size_t i = 0; i < replay.states.size(); i++)
+        {
+            if (replay.states[i])
+                states.restore(replay.from + i + 1, replay.states[i]);
+        }
+        states.restore(replay.to, std::move(result));
+
+        drop_cheap_states();
+        return true;
+    }
+
+    history_stats edit_stack::stats() const
+    {
+        return states.stats();
+    }
+
+    void edit_stack::forget_after(std::size_t i)
+    {
+        // From the end, so that no state is decoded only to be forgotten
+        for (std::size_t state = states.size(); state-- > i + 1;)
+            states.set(state, nullptr);
+        generation++;
+    }
+
+    void edit_stack::drop_cheap_states()
+    {
+        // Replaying from the previous stored state costs the durations of
+        // the enabled steps in between
+        double pending = 0;
+        for (std::size_t state = 1; state < states.size(); state++)
+        {
+            if (steps[state - 1].enabled)
+                pending += steps[state - 1].cost_ms;
+
+            if (!states.contains(state))
+                continue;
+
+            if (state == current || pending >= cache_interval)
+                pending = 0;
+            else
+                states.drop(state);
+        }
+
+        // A state followed by a stored one through an invertible step is
+        // computed back from it
+        for (std::size_t state = 1; state + 1 < states.size(); state++)
+        {
+            if (state != current && steps[state].enabled
+                && steps[state].inverse && states.contains(state)
+                && states.contains(state + 1))
+                states.drop(state);
+        }
+    }
+} // namespace tifo
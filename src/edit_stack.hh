@@ -0,0 +1,139 @@
+#ifndef TIFO_PROJECT_EDIT_STACK_HH
+#define TIFO_PROJECT_EDIT_STACK_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "history_store.hh"
+#include "image.hh"
+
+namespace tifo
+{
+    /** Computes a new image from the source, which must not be modified. */
+    using edit_operation = std::function<rgb24_image*(const rgb24_image&)>;
+
+    /**
+     * One step of an edit stack: an operation with its parameters bound.
+     */
+    struct edit_step
+    {
+        std::string name;
+        edit_operation operation;
+        /** Undoes the operation exactly, null when it cannot. */
+        edit_operation inverse;
+        bool enabled = true;
+        /** Last measured duration of the operation, in milliseconds. */
+        double cost_ms = 0;
+    };
+
+    /**
+     * Steps of an edit stack to replay from a stored state, prepared on the
+     * GUI thread by edit_stack::prepare_replay and run on a worker.
+     */
+    struct edit_replay
+    {
+        std::uint64_t generation = 0;
+        double cache_interval = 0;
+        std::size_t from = 0;
+        std::size_t to = 0;
+        std::shared_ptr<const rgb24_image> source;
+        std::vector<edit_step> steps;
+        /** Undo the steps from the later state instead of applying them. */
+        bool backward = false;
+
+        /**
+         * Filled by run(): the intermediate states worth storing (null for
+         * the others) and the duration of each step.
+         */
+        std::vector<std::shared_ptr<const rgb24_image>> states;
+        std::vector<double> costs;
+
+        /** Returns the last state, owned by the caller. */
+        rgb24_image* run();
+    };
+
+    /**
+     * Non-destructive editing history: the original image and the steps
+     * applied to it, state i being the image after the first i steps.
+     *
+     * States are only stored where replaying the steps since the previous
+     * stored state would take longer than the cache interval, according to
+     * the durations recorded for each step. The original and the current
+     * states are always stored. Editing or toggling a step forgets the
+     * states after it, which are then replayed from the closest stored one.
+     *
+     * Steps with an exact inverse (flips, negative...) cost nothing to
+     * store: the state before one is not kept when the state after it is,
+     * and is computed back by undoing the step.
+     */
+    class edit_stack
+    {
+    public:
+        edit_stack(std::size_t budget_bytes, double cache_interval_ms);
+
+        void reset(std::shared_ptr<const rgb24_image> original);
+
+        /** Number of states, one more than the number of steps. */
+        std::size_t size() const;
+        bool empty() const;
+
+        /** Identifier of a state, changed whenever its image changes. */
+        std::uint64_t id(std::size_t state) const;
+        bool contains(std::size_t state) const;
+        /** Image of a state, null when it has to be replayed. */
+        std::shared_ptr<const rgb24_image> get(std::size_t state);
+
+        /** Step i leads from state i to state i + 1. */
+        const edit_step& step(std::size_t i) const;
+
+        /**
+         * Adds a step after the given state, whose result is the image of
+         * the new current state. The steps that followed are dropped.
+         * changed bounds the pixels the step modified, when known.
+         */
+        void apply(std::size_t state, edit_step step,
+                   std::shared_ptr<const rgb24_image> result,
+                   std::optional<image_rect> changed = std::nullopt);
+
+        void set_enabled(std::size_t i, bool enabled);
+        void replace(std::size_t i, std::string name,
+                     edit_operation operation, edit_operation inverse);
+
+        /** Drops the states from count on, with their steps. */
+        void truncate(std::size_t count);
+
+        void set_current(std::size_t state);
+
+        /**
+         * Steps leading to a state from the closest stored one, or undoing
+         * back to it from a later one when that is cheaper.
+         */
+        std::shared_ptr<edit_replay> prepare_replay(std::size_t state);
+
+        /**
+         * Stores the states computed by a replay, result being the last one.
+         * Returns false if the stack changed since it was prepared.
+         */
+        bool finish_replay(const edit_replay& replay,
+                           std::shared_ptr<const rgb24_image> result);
+
+        history_stats stats() const;
+
+    private:
+        void forget_after(std::size_t state);
+        void drop_cheap_states();
+
+        history_store states;
+        std::vector<edit_step> steps;
+        double cache_interval;
+        std::size_t current = 0;
+        std::uint64_t generation = 0;
+    };
+} // namespace tifo
+
+#endif //TIFO_PROJECT_EDIT_STACK_HH
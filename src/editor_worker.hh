@@ -0,0 +1,164 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QMetaType>
+#include <QString>
+#include <QThread>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "image.hh"
+#include "scheduler.hh"
+
+using ImagePtr = std::shared_ptr<tifo::rgb24_image>;
+using ConstImagePtr = std::shared_ptr<const tifo::rgb24_image>;
+
+Q_DECLARE_METATYPE(ImagePtr)
+
+/**
+ * Background thread running the editor operations. Only the newest job is
+ * worth computing: submitting one cancels the queued and running ones, whose
+ * kernels then stop at the next row band.
+ */
+class EditorWorker : public QThread
+{
+    Q_OBJECT
+
+public:
+    /** Computes a new image from the source, which must not be modified. */
+    using Operation =
+        std::function<tifo::rgb24_image*(const tifo::rgb24_image&)>;
+
+    /**
+     * A background worker runs its jobs on its own thread only, see
+     * tifo::job_context::background.
+     */
+    explicit EditorWorker(QObject* parent = nullptr, bool background = false)
+        : QThread(parent)
+        , background(background)
+    {
+        qRegisterMetaType<ImagePtr>();
+    }
+
+    ~EditorWorker() override
+    {
+        stop();
+    }
+
+    quint64 submit(ConstImagePtr source, Operation operation)
+    {
+        auto job = std::make_shared<Job>();
+        job->source = std::move(source);
+        job->operation = std::move(operation);
+        job->context.background = background;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        cancelLocked();
+
+        job->id = ++lastId;
+        job->context.progress = [this, id = job->id](int percent) {
+            emit progress(id, percent);
+        };
+
+        jobs.push_back(job);
+        wake.notify_one();
+
+        return job->id;
+    }
+
+    void cancelAll()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancelLocked();
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            cancelLocked();
+        }
+        wake.notify_all();
+        wait();
+    }
+
+signals:
+    void progress(quint64 id, int percent);
+    void finished(quint64 id, ImagePtr result, qint64 elapsed);
+    void failed(quint64 id, QString reason);
+
+protected:
+    void run() override
+    {
+        for (;;)
+        {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping)
+                    return;
+
+                job = jobs.back();
+                jobs.clear();
+                running = job;
+            }
+
+            QElapsedTimer timer;
+            timer.start();
+
+            ImagePtr result;
+            try
+            {
+                tifo::job_scope scope(&job->context);
+                result.reset(job->operation(*job->source));
+            }
+            catch (const tifo::cancelled&)
+            {}
+            catch (const std::exception& e)
+            {
+                emit failed(job->id, QString(e.what()));
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running.reset();
+            }
+
+            if (result && !job->context.is_cancelled())
+                emit finished(job->id, result, timer.elapsed());
+        }
+    }
+
+private:
+    struct Job
+    {
+        quint64 id;
+        ConstImagePtr source;
+        Operation operation;
+        tifo::job_context context;
+    };
+
+    void cancelLocked()
+    {
+        for (auto& job : jobs)
+            job->context.cancel();
+        jobs.clear();
+
+        if (running)
+            running->context.cancel();
+    }
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::shared_ptr<Job>> jobs;
+    std::shared_ptr<Job> running;
+    quint64 lastId = 0;
+    bool stopping = false;
+    const bool background;
+};
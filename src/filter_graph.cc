@@ -0,0 +1,586 @@
+#include "filter_graph.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include "filters.hh"
+#include "histogram_operations.hh"
+#include "image_convert.hh"
+#include "image_operations.hh"
+#include "layers.hh"
+#include "region.hh"
+#include "scheduler.hh"
+
+namespace tifo
+{
+    namespace
+    {
+        // Bytes of a band of a stencil pass: small enough to stay in L2,
+        // large enough for the halo rows to be recomputed rarely
+        constexpr int band_bytes = 1 << 20;
+
+        graph_node conversion_node(const char* name, pixel_function function)
+        {
+            graph_node node;
+            node.name = name;
+            node.point = std::move(function);
+            return node;
+        }
+
+        const graph_node rgb_to_hsv_node =
+            conversion_node("rgb to hsv", rgb_to_hsv_pixels);
+        const graph_node hsv_to_rgb_node =
+            conversion_node("hsv to rgb", hsv_to_rgb_pixels);
+        const graph_node rgb_to_yCrCb_node =
+            conversion_node("rgb to yCrCb", rgb_to_YCrCb_pixels);
+        const graph_node yCrCb_to_rgb_node =
+            conversion_node("yCrCb to rgb", yCrCb_to_rgb_pixels);
+
+        // Adds the conversions from one space to the other, through RGB
+        void convert(std::vector<const graph_node*>& steps, color_space from,
+                     color_space to)
+        {
+            if (from == to)
+                return;
+
+            if (from == color_space::hsv)
+                steps.push_back(&hsv_to_rgb_node);
+            else if (from == color_space::yCrCb)
+                steps.push_back(&yCrCb_to_rgb_node);
+
+            if (to == color_space::hsv)
+                steps.push_back(&rgb_to_hsv_node);
+            else if (to == color_space::yCrCb)
+                steps.push_back(&rgb_to_yCrCb_node);
+        }
+
+        /**
+         * Pass over the whole image: its steps are fused, each row or band
+         * goes through all of them before the next one is read.
+         */
+        struct graph_pass
+        {
+            /** Buffer read, 0 being the input image. */
+            int source = 0;
+            /** Combine: buffer blended into the source. */
+            int second = -1;
+            /** Global or combine node run before the steps. */
+            const graph_node* head = nullptr;
+            std::vector<const graph_node*> steps;
+            /** Run by bands, as soon as one of the steps is a stencil. */
+            bool banded = false;
+            /** Sum of the halos of the stencil steps. */
+            int halo = 0;
+        };
+
+        // Pass k writes buffer k + 1. An image is only kept in a buffer
+        // where it is the output, read by several nodes, or read whole by
+        // a global or combine node; everything else stays in the bands.
+        std::vector<graph_pass> make_plan(const std::vector<graph_node>& nodes,
+                                          int output)
+        {
+            int count = nodes.size();
+
+            std::vector<bool> needed(count, false);
+            needed[output] = true;
+            for (int i = output; i > 0; i--)
+            {
+                if (!needed[i])
+                    continue;
+                for (int from : nodes[i].inputs)
+                    needed[from] = true;
+            }
+
+            std::vector<int> readers(count, 0);
+            std::vector<int> reader(count, -1);
+            std::vector<bool> stored(count, false);
+            stored[filter_graph::input] = true;
+            stored[output] = true;
+            for (int i = 1; i < count; i++)
+            {
+                if (!needed[i])
+                    continue;
+
+                bool whole = nodes[i].access == access_pattern::global
+                    || nodes[i].access == access_pattern::combine;
+                for (int from : nodes[i].inputs)
+                {
+                    readers[from]++;
+                    reader[from] = i;
+                    if (whole)
+                        stored[from] = true;
+                }
+                if (nodes[i].access == access_pattern::combine)
+                    stored[i] = true;
+            }
+            for (int i = 0; i < count; i++)
+            {
+                if (readers[i] > 1)
+                    stored[i] = true;
+            }
+
+            std::vector<graph_pass> passes;
+            std::vector<color_space> spaces{ color_space::rgb };
+            std::vector<int> buffers(count, -1);
+            buffers[filter_graph::input] = 0;
+
+            // Buffer with the image of a node in the given space
+            auto in_space = [&](int node, color_space space) {
+                int buffer = buffers[node];
+                if (spaces[buffer] == space)
+                    return buffer;
+
+                graph_pass pass;
+                pass.source = buffer;
+                convert(pass.steps, spaces[buffer], space);
+                passes.push_back(std::move(pass));
+                spaces.push_back(space);
+                return (int)passes.size();
+            };
+
+            for (int i = 1; i < count; i++)
+            {
+                if (!needed[i] || !stored[i])
+                    continue;
+
+                // Nodes computed since the last stored image
+                std::vector<int> chain{ i };
+                for (;;)
+                {
+                    auto& node = nodes[chain.back()];
+                    if (node.access == access_pattern::global
+                        || node.access == access_pattern::combine
+                        || stored[node.inputs[0]])
+                        break;
+                    chain.push_back(node.inputs[0]);
+                }
+                std::reverse(chain.begin(), chain.end());
+
+                graph_pass pass;
+                auto& head = nodes[chain[0]];
+                color_space current = head.space;
+                std::size_t first = 1;
+                if (head.access == access_pattern::combine)
+                {
+                    pass.source = in_space(head.inputs[0], head.space);
+                    pass.second = in_space(head.inputs[1], head.space);
+                    pass.head = &head;
+                }
+                else if (head.access == access_pattern::global)
+                {
+                    pass.source = in_space(head.inputs[0], head.space);
+                    pass.head = &head;
+                }
+                else
+                {
+                    pass.source = buffers[head.inputs[0]];
+                    current = spaces[pass.source];
+                    first = 0;
+                }
+
+                for (std::size_t k = first; k < chain.size(); k++)
+                {
+                    auto& node = nodes[chain[k]];
+                    convert(pass.steps, current, node.space);
+                    pass.steps.push_back(&node);
+                    pass.banded |= node.access == access_pattern::stencil;
+                    pass.halo += node.halo;
+                    current = node.space;
+                }
+                // Converted for its reader in the same pass
+                color_space wanted = current;
+                if (i == output)
+                    wanted = color_space::rgb;
+                else if (readers[i] == 1)
+                    wanted = nodes[reader[i]].space;
+                convert(pass.steps, current, wanted);
+                current = wanted;
+
+                passes.push_back(std::move(pass));
+                spaces.push_back(current);
+                buffers[i] = passes.size();
+            }
+
+            return passes;
+        }
+
+        void run_steps(const std::vector<const graph_node*>& steps,
+                       rgb24_image& image, uint8_t* pixels, int count)
+        {
+            for (auto step : steps)
+            {
+                if (step->access == access_pattern::stencil)
+                    step->stencil(image);
+                else
+                    step->point(pixels, count);
+            }
+        }
+
+        int band_rows(const rgb24_image& image, int halo)
+        {
+            int rows = std::max(band_bytes / (image.sx * 3), 4 * halo);
+            // Enough bands for all the threads
+            int threads = thread_count();
+            rows = std::min(rows, (image.sy + threads - 1) / threads);
+            return std::max(rows, 1);
+        }
+
+        rgb24_image* run_pass(const graph_pass& pass,
+                              const rgb24_image& source,
+                              const rgb24_image* second)
+        {
+            int row = source.sx * 3;
+
+            if (pass.head && pass.head->access == access_pattern::combine)
+            {
+                auto target = std::make_unique<rgb24_image>(source);
+                pass.head->combine(*target, *second);
+
+                // Only conversions follow a combine
+                parallel_rows(target->sy, [&](int begin, int end) {
+                    run_steps(pass.steps, *target, target->pixels + begin * row,
+                              (end - begin) * target->sx);
+                });
+                return target.release();
+            }
+
+            pixel_function prepared;
+            if (pass.head)
+                prepared = pass.head->global(source);
+
+            auto target = std::make_unique<rgb24_image>(source.sx, source.sy);
+
+            if (!pass.banded)
+            {
+                parallel_rows(source.sy, [&](int begin, int end) {
+                    for (int y = begin; y < end; y++)
+                    {
+                        uint8_t* out = target->pixels + y * row;
+                        std::memcpy(out, source.pixels + y * row, row);
+                        if (prepared)
+                            prepared(out, source.sx);
+                        run_steps(pass.steps, *target, out, source.sx);
+                    }
+                });
+                return target.release();
+            }
+
+            int rows = band_rows(source, pass.halo);
+            int bands = (source.sy + rows - 1) / rows;
+            parallel_rows(bands, [&](int begin, int end) {
+                for (int band = begin; band < end; band++)
+                {
+                    int y0 = band * rows;
+                    int y1 = std::min(y0 + rows, source.sy);
+                    image_rect area{ 0, std::max(y0 - pass.halo, 0), source.sx,
+                                     std::min(y1 + pass.halo, source.sy) };
+
+                    std::unique_ptr<rgb24_image> tile(crop(source, area));
+                    int count = tile->sx * tile->sy;
+                    if (prepared)
+                        prepared(tile->pixels, count);
+                    run_steps(pass.steps, *tile, tile->pixels, count);
+
+                    std::memcpy(target->pixels + y0 * row,
+                                tile->pixels + (y0 - area.y0) * row,
+                                (y1 - y0) * row);
+                }
+            });
+            return target.release();
+        }
+    } // namespace
+
+    filter_graph::filter_graph()
+    {
+        graph_node image;
+        image.name = "input";
+        nodes.push_back(std::move(image));
+    }
+
+    int filter_graph::add(graph_node node)
+    {
+        for (int from : node.inputs)
+        {
+            if (from < 0 || from >= (int)nodes.size())
+                throw std::invalid_argument("Unknown input node");
+        }
+
+        nodes.push_back(std::move(node));
+        output = nodes.size() - 1;
+        return output;
+    }
+
+    int filter_graph::add_point(std::string name, color_space space,
+                                pixel_function function, int from)
+    {
+        graph_node node;
+        node.name = std::move(name);
+        node.space = space;
+        node.inputs = { from };
+        node.point = std::move(function);
+        return add(std::move(node));
+    }
+
+    int filter_graph::add_stencil(std::string name, color_space space,
+                                  int halo,
+                                  std::function<void(rgb24_image&)> function,
+                                  int from)
+    {
+        graph_node node;
+        node.name = std::move(name);
+        node.space = space;
+        node.access = access_pattern::stencil;
+        node.halo = halo;
+        node.inputs = { from };
+        node.stencil = std::move(function);
+        return add(std::move(node));
+    }
+
+    int filter_graph::add_channel_stencil(
+        std::string name, color_space space, int channel, int halo,
+        std::function<void(gray8_image&)> function, int from, uint8_t max)
+    {
+        if (channel < 0 || channel > 2)
+            throw std::invalid_argument("No such channel");
+
+        auto stencil = [=](rgb24_image& image) {
+            int count = image.sx * image.sy;
+            gray8_image plane(image.sx, image.sy);
+            for (int i = 0; i < count; i++)
+                plane.pixels[i] = image.pixels[i * 3 + channel];
+
+            function(plane);
+
+            for (int i = 0; i < count; i++)
+                image.pixels[i * 3 + channel] = std::min(plane.pixels[i], max);
+        };
+
+        return add_stencil(std::move(name), space, halo, stencil, from);
+    }
+
+    int filter_graph::add_global(
+        std::string name, color_space space,
+        std::function<pixel_function(const rgb24_image&)> function, int from)
+    {
+        graph_node node;
+        node.name = std::move(name);
+        node.space = space;
+        node.access = access_pattern::global;
+        node.inputs = { from };
+        node.global = std::move(function);
+        return add(std::move(node));
+    }
+
+    int filter_graph::add_combine(
+        std::string name, color_space space,
+        std::function<void(rgb24_image&, const rgb24_image&)> function,
+        int first, int second)
+    {
+        graph_node node;
+        node.name = std::move(name);
+        node.space = space;
+        node.access = access_pattern::combine;
+        node.inputs = { first, second };
+        node.combine = std::move(function);
+        return add(std::move(node));
+    }
+
+    void filter_graph::set_output(int node)
+    {
+        if (node < 0 || node >= (int)nodes.size())
+            throw std::invalid_argument("Unknown output node");
+        output = node;
+    }
+
+    std::vector<std::string> filter_graph::describe() const
+    {
+        std::vector<std::string> lines;
+
+        auto passes = make_plan(nodes, output);
+        for (std::size_t k = 0; k < passes.size(); k++)
+        {
+            auto& pass = passes[k];
+            std::string line = "pass " + std::to_string(k + 1) + ":";
+
+            std::vector<const graph_node*> steps;
+            if (pass.head)
+                steps.push_back(pass.head);
+            steps.insert(steps.end(), pass.steps.begin(), pass.steps.end());
+            for (std::size_t i = 0; i < steps.size(); i++)
+                line += (i == 0 ? " " : ", ") + steps[i]->name;
+
+            if (pass.banded)
+                line += " (bands, halo " + std::to_string(pass.halo) + ")";
+            lines.push_back(line);
+        }
+
+        return lines;
+    }
+
+    rgb24_image* filter_graph::run(const rgb24_image& image) const
+    {
+        auto passes = make_plan(nodes, output);
+        if (passes.empty())
+            return new rgb24_image(image);
+
+        // Last pass reading each buffer, so that they are freed early
+        std::vector<int> last_read(passes.size() + 1, -1);
+        for (std::size_t k = 0; k < passes.size(); k++)
+        {
+            last_read[passes[k].source] = k;
+            if (passes[k].second >= 0)
+                last_read[passes[k].second] = k;
+        }
+
+        std::vector<std::unique_ptr<rgb24_image>> buffers(passes.size() + 1);
+        auto buffer = [&](int b) -> const rgb24_image& {
+            return b == 0 ? image : *buffers[b];
+        };
+
+        for (std::size_t k = 0; k < passes.size(); k++)
+        {
+            auto& pass = passes[k];
+            buffers[k + 1].reset(
+                run_pass(pass, buffer(pass.source),
+                         pass.second >= 0 ? &buffer(pass.second) : nullptr));
+
+            for (std::size_t b = 1; b <= k; b++)
+            {
+                if (last_read[b] == (int)k)
+                    buffers[b].reset();
+            }
+        }
+
+        return buffers.back().release();
+    }
+
+    namespace
+    {
+        // Equalization of Y from the histogram of the whole image
+        pixel_function equalize_y(const rgb24_image& image)
+        {
+            auto table = std::make_shared<level_table>(
+                equalize_table(channel_histogram(image, 0), 255));
+
+            return [table](uint8_t* pixels, int n) {
+                for (int i = 0; i < n * 3; i += 3)
+                    pixels[i] = (*table)[pixels[i]];
+            };
+        }
+
+        int blur(filter_graph& graph, float sigma)
+        {
+            return graph.add_stencil(
+                "gaussian", color_space::rgb, 2,
+                [=](rgb24_image& image) { rgb_gaussian(image, 5, sigma); },
+                filter_graph::input);
+        }
+    } // namespace
+
+    filter_graph ir_filter_graph()
+    {
+        filter_graph graph;
+
+        int node = graph.add_point(
+            "hue -50", color_space::hsv,
+            [](uint8_t* pixels, int count) { hue_pixels(pixels, count, -50); },
+            filter_graph::input);
+        node = graph.add_point(
+            "saturation -50", color_space::hsv,
+            [](uint8_t* pixels, int count) {
+                saturation_pixels(pixels, count, -50);
+            },
+            node);
+        node = graph.add_point(
+            "swap red and blue", color_space::rgb,
+            [](uint8_t* pixels, int count) {
+                swap_channels_pixels(pixels, count, RED, BLUE);
+            },
+            node);
+        node = graph.add_point(
+            "blue +20", color_space::rgb,
+            [](uint8_t* pixels, int count) {
+                increase_channel_pixels(pixels, count, 20, BLUE);
+            },
+            node);
+        graph.add_global("equalize Y", color_space::yCrCb, equalize_y, node);
+
+        return graph;
+    }
+
+    filter_graph sobel_hsv_graph()
+    {
+        filter_graph graph;
+        graph.add_channel_stencil("sobel V", color_space::hsv, 2, 1,
+                                  sobel_filter, blur(graph, 2.0), 100);
+        return graph;
+    }
+
+    filter_graph sobel_yCrCb_graph()
+    {
+        filter_graph graph;
+        graph.add_channel_stencil("sobel Y", color_space::yCrCb, 0, 1,
+                                  sobel_filter, blur(graph, 2.0));
+        return graph;
+    }
+
+    filter_graph laplacien_filter_hsv_graph(float k)
+    {
+        filter_graph graph;
+        graph.add_channel_stencil(
+            "laplacian V", color_space::hsv, 2, 1,
+            [=](gray8_image& plane) { laplacien_filter(plane, k); },
+            blur(graph, 2.0), 100);
+        return graph;
+    }
+
+    filter_graph laplacien_filter_yCrCb_graph(float k)
+    {
+        filter_graph graph;
+        graph.add_channel_stencil(
+            "laplacian Y", color_space::yCrCb, 0, 1,
+            [=](gray8_image& plane) { laplacien_filter(plane, k); },
+            blur(graph, 2.0));
+        return graph;
+    }
+
+    filter_graph glow_filter_graph(float blur_radius, int threshold)
+    {
+        filter_graph graph;
+
+        int glow = graph.add_point(
+            "threshold", color_space::rgb,
+            [=](uint8_t* pixels, int count) {
+                for (int i = 0; i < count * 3; i++)
+                    pixels[i] = std::max(pixels[i] - threshold, 0);
+            },
+            blur(graph, blur_radius));
+        graph.add_combine(
+            "add", color_space::rgb,
+            [](rgb24_image& image, const rgb24_image& layer) {
+                // The layer is only borrowed for the blend
+                std::shared_ptr<const rgb24_image> borrowed(
+                    &layer, [](const rgb24_image*) {});
+                flatten_layers(image,
+                               { { borrowed, blend_mode::add, 1.0f,
+                                   nullptr } });
+            },
+            filter_graph::input, glow);
+
+        return graph;
+    }
+
+    rgb24_image* ir_filter_fused(const rgb24_image& image)
+    {
+        return ir_filter_graph().run(image);
+    }
+
+    rgb24_image* glow_filter_fused(const rgb24_image& image,
+                                   float blur_radius, int threshold)
+    {
+        return glow_filter_graph(blur_radius, threshold).run(image);
+    }
+} // namespace tifo
@@ -0,0 +1,126 @@
+#ifndef TIFO_PROJECT_FILTER_GRAPH_HH
+#define TIFO_PROJECT_FILTER_GRAPH_HH
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "image.hh"
+
+namespace tifo
+{
+    enum class color_space
+    {
+        rgb,
+        hsv,
+        yCrCb,
+    };
+
+    /** How a node reads its input, which decides how it is scheduled. */
+    enum class access_pattern
+    {
+        /** Each pixel from the same input pixel only. */
+        point,
+        /** Each pixel from the input pixels at most halo away. */
+        stencil,
+        /** Needs the whole input, a histogram, before the first pixel. */
+        global,
+        /** Blends the second input into the first. */
+        combine,
+    };
+
+    /** Transforms count consecutive pixels in place. */
+    using pixel_function = std::function<void(uint8_t* pixels, int count)>;
+
+    struct graph_node
+    {
+        std::string name;
+        /** Color space of the pixels read and written. */
+        color_space space = color_space::rgb;
+        access_pattern access = access_pattern::point;
+        /** Stencil: pixels read around each computed one. */
+        int halo = 0;
+        /** Nodes read, filter_graph::input being the image. */
+        std::vector<int> inputs;
+
+        pixel_function point;
+        /** Applied to a band of the image with the halo around it. */
+        std::function<void(rgb24_image&)> stencil;
+        /** Point function to apply, computed from the whole input. */
+        std::function<pixel_function(const rgb24_image&)> global;
+        std::function<void(rgb24_image&, const rgb24_image&)> combine;
+    };
+
+    /**
+     * Filter described as a graph of operations rather than a sequence of
+     * passes over the image. Conversions are inserted only where two
+     * nodes work in different color spaces, consecutive point nodes run in
+     * the same pass over each row, and stencils run by bands sized to stay
+     * in cache, recomputing their halo. A single channel stencil extracts
+     * and writes back its channel one band at a time.
+     */
+    class filter_graph
+    {
+    public:
+        static constexpr int input = 0;
+
+        filter_graph();
+
+        /** Each add_ function returns the id of the node. */
+        int add_point(std::string name, color_space space,
+                      pixel_function function, int from);
+        int add_stencil(std::string name, color_space space, int halo,
+                        std::function<void(rgb24_image&)> function, int from);
+        /**
+         * Stencil on one channel, the others are left alone. The values
+         * written back are clamped to max.
+         */
+        int add_channel_stencil(std::string name, color_space space,
+                                int channel, int halo,
+                                std::function<void(gray8_image&)> function,
+                                int from, uint8_t max = 255);
+        int add_global(
+            std::string name, color_space space,
+            std::function<pixel_function(const rgb24_image&)> function,
+            int from);
+        int add_combine(
+            std::string name, color_space space,
+            std::function<void(rgb24_image&, const rgb24_image&)> function,
+            int first, int second);
+
+        /** The result is the last node added unless set otherwise. */
+        void set_output(int node);
+
+        /** The passes run, one line each with the steps fused in it. */
+        std::vector<std::string> describe() const;
+
+        /** Result of the graph on image, in RGB. */
+        rgb24_image* run(const rgb24_image& image) const;
+
+    private:
+        int add(graph_node node);
+
+        std::vector<graph_node> nodes;
+        int output = input;
+    };
+
+    // The named filters as graphs, to compare with their hand-written
+    // chains of passes
+    filter_graph ir_filter_graph();
+    filter_graph sobel_hsv_graph();
+    filter_graph sobel_yCrCb_graph();
+    filter_graph laplacien_filter_hsv_graph(float k);
+    filter_graph laplacien_filter_yCrCb_graph(float k);
+    filter_graph glow_filter_graph(float blur_radius, int threshold);
+
+    /**
+     * ir_filter and glow_filter run through their graphs, in fewer passes
+     * over the image. The editor applies these.
+     */
+    rgb24_image* ir_filter_fused(const rgb24_image& image);
+    rgb24_image* glow_filter_fused(const rgb24_image& image,
+                                   float blur_radius, int threshold);
+} // namespace tifo
+
+#endif //TIFO_PROJECT_FILTER_GRAPH_HH
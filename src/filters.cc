@@ -5,8 +5,12 @@
 
 #include <QDebug>
 #include <algorithm>
+#include <memory>
 #include <vector>
 
+#include "layers.hh"
+#include "scheduler.hh"
+
 namespace tifo
 {
 
@@ -21,26 +25,29 @@ namespace tifo
 
         auto new_image = new gray8_image(image.sx, image.sy);
 
-        for (int y = maskSize / 2; y < image.sy - maskSize / 2; ++y)
-        {
-            for (int x = maskSize / 2; x < image.sx - maskSize / 2; ++x)
-            {
-                uint8_t sum = 0;
+        int half = maskSize / 2;
 
-                for (int dy = -maskSize / 2; dy <= maskSize / 2; ++dy)
+        parallel_rows(image.sy - 2 * half, [&](int begin, int end) {
+            for (int y = begin + half; y < end + half; ++y)
+            {
+                for (int x = half; x < image.sx - half; ++x)
                 {
-                    for (int dx = -maskSize / 2; dx <= maskSize / 2; ++dx)
+                    uint8_t sum = 0;
+
+                    for (int dy = -half; dy <= half; ++dy)
                     {
-                        auto pixel =
-                            image.pixels[(y + dy) * image.sx + (x + dx)];
-                        sum +=
-                            pixel * mask[dy + maskSize / 2][dx + maskSize / 2];
+                        for (int dx = -half; dx <= half; ++dx)
+                        {
+                            auto pixel =
+                                image.pixels[(y + dy) * image.sx + (x + dx)];
+                            sum += pixel * mask[dy + half][dx + half];
+                        }
                     }
-                }
 
-                new_image->pixels[y * new_image->sx + x] = sum;
+                    new_image->pixels[y * new_image->sx + x] = sum;
+                }
             }
-        }
+        });
 
         return new_image;
     }
@@ -58,13 +65,15 @@ namespace tifo
         auto imageHorizontal = applyMask(image, sobelHorizontal);
         auto imageVertical = applyMask(image, sobelVertical);
 
-        for (int i = 0; i < image.length; i++)
-        {
-            float magnitude =
-                sqrt((imageHorizontal->pixels[i] * imageHorizontal->pixels[i])
-                     + (imageVertical->pixels[i] * imageVertical->pixels[i]));
-            image.pixels[i] = static_cast<uint8_t>(magnitude);
-        }
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin * image.sx; i < end * image.sx; i++)
+            {
+                float magnitude = sqrt(
+                    (imageHorizontal->pixels[i] * imageHorizontal->pixels[i])
+                    + (imageVertical->pixels[i] * imageVertical->pixels[i]));
+                image.pixels[i] = static_cast<uint8_t>(magnitude);
+            }
+        });
 
         delete imageHorizontal;
         delete imageVertical;
@@ -76,12 +85,14 @@ namespace tifo
 
         sobel_filter(*gray);
 
-        for (int i = 0; i < image.sx * image.sy; i++)
-        {
-            image.pixels[i * 3] = gray->pixels[i];
-            image.pixels[i * 3 + 1] = gray->pixels[i];
-            image.pixels[i * 3 + 2] = gray->pixels[i];
-        }
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin * image.sx; i < end * image.sx; i++)
+            {
+                image.pixels[i * 3] = gray->pixels[i];
+                image.pixels[i * 3 + 1] = gray->pixels[i];
+                image.pixels[i * 3 + 2] = gray->pixels[i];
+            }
+        });
 
         delete gray;
     }
@@ -96,18 +107,20 @@ namespace tifo
         sobel_filter(*colors[1]);
         sobel_filter(*colors[2]);
 
-        for (int y = 0; y < image.sy; ++y)
-        {
-            for (int x = 0; x < image.sx; ++x)
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int y = begin; y < end; ++y)
             {
-                image.pixels[(y * image.sx + x) * 3] =
-                    colors[0]->pixels[y * image.sx + x];
-                image.pixels[(y * image.sx + x) * 3 + 1] =
-                    colors[1]->pixels[y * image.sx + x];
-                image.pixels[(y * image.sx + x) * 3 + 2] =
-                    colors[2]->pixels[y * image.sx + x];
+                for (int x = 0; x < image.sx; ++x)
+                {
+                    image.pixels[(y * image.sx + x) * 3] =
+                        colors[0]->pixels[y * image.sx + x];
+                    image.pixels[(y * image.sx + x) * 3 + 1] =
+                        colors[1]->pixels[y * image.sx + x];
+                    image.pixels[(y * image.sx + x) * 3 + 2] =
+                        colors[2]->pixels[y * image.sx + x];
+                }
             }
-        }
+        });
 
         for (auto obj : colors)
         {
@@ -123,15 +136,17 @@ namespace tifo
 
         auto imageLaplacian = applyMask(image, laplacian);
 
-        for (int i = 0; i < image.sx * image.sy; i++)
-        {
-            float newValue =
-                (float)image.pixels[i] + (k * (float)imageLaplacian->pixels[i]);
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin * image.sx; i < end * image.sx; i++)
+            {
+                float newValue = (float)image.pixels[i]
+                    + (k * (float)imageLaplacian->pixels[i]);
 
-            newValue = std::max(0.0f, std::min(255.0f, newValue));
+                newValue = std::max(0.0f, std::min(255.0f, newValue));
 
-            image.pixels[i] = static_cast<uint8_t>(newValue);
-        }
+                image.pixels[i] = static_cast<uint8_t>(newValue);
+            }
+        });
 
         delete imageLaplacian;
     }
@@ -146,18 +161,20 @@ namespace tifo
         laplacien_filter(*colors[1], k);
         laplacien_filter(*colors[2], k);
 
-        for (int y = 0; y < image.sy; ++y)
-        {
-            for (int x = 0; x < image.sx; ++x)
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int y = begin; y < end; ++y)
             {
-                image.pixels[(y * image.sx + x) * 3] =
-                    colors[0]->pixels[y * image.sx + x];
-                image.pixels[(y * image.sx + x) * 3 + 1] =
-                    colors[1]->pixels[y * image.sx + x];
-                image.pixels[(y * image.sx + x) * 3 + 2] =
-                    colors[2]->pixels[y * image.sx + x];
+                for (int x = 0; x < image.sx; ++x)
+                {
+                    image.pixels[(y * image.sx + x) * 3] =
+                        colors[0]->pixels[y * image.sx + x];
+                    image.pixels[(y * image.sx + x) * 3 + 1] =
+                        colors[1]->pixels[y * image.sx + x];
+                    image.pixels[(y * image.sx + x) * 3 + 2] =
+                        colors[2]->pixels[y * image.sx + x];
+                }
             }
-        }
+        });
 
         for (auto obj : colors)
         {
@@ -169,110 +186,36 @@ namespace tifo
     {
         rgb_gaussian(image, 5, 2.0);
 
-        rgb_to_YCrCb(image);
-
-        auto colors = rgb_to_gray_color(image);
-
-        laplacien_filter(*colors[0], k);
-
-        for (int y = 0; y < image.sy; ++y)
-        {
-            for (int x = 0; x < image.sx; ++x)
-            {
-                image.pixels[(y * image.sx + x) * 3] =
-                    colors[0]->pixels[y * image.sx + x];
-            }
-        }
-
-        yCrCb_to_rgb(image);
-
-        for (auto obj : colors)
-        {
-            delete obj;
-        }
+        std::unique_ptr<gray8_image> plane(rgb_to_Y(image));
+        laplacien_filter(*plane, k);
+        inject_Y(image, *plane);
     }
 
     void sobel_yCrCb(rgb24_image& image)
     {
         rgb_gaussian(image, 5, 2.0);
 
-        rgb_to_YCrCb(image);
-
-        auto colors = rgb_to_gray_color(image);
-
-        sobel_filter(*colors[0]);
-
-        for (int y = 0; y < image.sy; ++y)
-        {
-            for (int x = 0; x < image.sx; ++x)
-            {
-                image.pixels[(y * image.sx + x) * 3] =
-                    colors[0]->pixels[y * image.sx + x];
-            }
-        }
-
-        yCrCb_to_rgb(image);
-
-        for (auto obj : colors)
-        {
-            delete obj;
-        }
+        std::unique_ptr<gray8_image> plane(rgb_to_Y(image));
+        sobel_filter(*plane);
+        inject_Y(image, *plane);
     }
 
     void laplacien_filter_hsv(hsv24_image& image, float k)
     {
         rgb_gaussian(image, 5, 2.0);
 
-        rgb_to_hsv(image);
-
-        auto colors = hsv_to_gray_color(image);
-
-        laplacien_filter(*colors[2], k);
-
-        for (int y = 0; y < image.sy; ++y)
-        {
-            for (int x = 0; x < image.sx; ++x)
-            {
-                image.pixels[(y * image.sx + x) * 3 + 2] =
-                    std::clamp(colors[2]->pixels[y * image.sx + x], (uint8_t)0,
-                               (uint8_t)100);
-            }
-        }
-
-        hsv_to_rgb(image);
-
-        for (auto obj : colors)
-        {
-            delete obj;
-        }
+        std::unique_ptr<gray8_image> plane(rgb_to_V(image));
+        laplacien_filter(*plane, k);
+        inject_V(image, *plane);
     }
 
     void sobel_hsv(hsv24_image& image)
     {
         rgb_gaussian(image, 5, 2.0);
 
-        rgb_to_hsv(image);
-
-        auto colors = hsv_to_gray_color(image);
-
-        sobel_filter(*colors[2]);
-
-        for (int y = 0; y < image.sy; ++y)
-        {
-            for (int x = 0; x < image.sx; ++x)
-            {
-                image.pixels[(y * image.sx + x) * 3 + 2] =
-                    std::clamp(colors[2]->pixels[y * image.sx + x], (uint8_t)0,
-                               (uint8_t)100);
-            }
-        }
-
-        hsv_to_rgb(image);
-
-        for (auto obj : colors)
-        {
-            delete obj;
-        }
+        std::unique_ptr<gray8_image> plane(rgb_to_V(image));
+        sobel_filter(*plane);
+        inject_V(image, *plane);
     }
 
     void laplacian_gray(rgb24_image& image, float k)
@@ -281,12 +224,14 @@ namespace tifo
 
         laplacien_filter(*gray, k);
 
-        for (int i = 0; i < image.sx * image.sy; i++)
-        {
-            image.pixels[i * 3] = gray->pixels[i];
-            image.pixels[i * 3 + 1] = gray->pixels[i];
-            image.pixels[i * 3 + 2] = gray->pixels[i];
-        }
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin * image.sx; i < end * image.sx; i++)
+            {
+                image.pixels[i * 3] = gray->pixels[i];
+                image.pixels[i * 3 + 1] = gray->pixels[i];
+                image.pixels[i * 3 + 2] = gray->pixels[i];
+            }
+        });
 
         delete gray;
     }
@@ -334,18 +279,20 @@ namespace tifo
         auto blurredGreen = applyMask(*colors[1], filter);
         auto blurredBlue = applyMask(*colors[2], filter);
 
-        for (int y = 0; y < image.sy; ++y)
-        {
-            for (int x = 0; x < image.sx; ++x)
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int y = begin; y < end; ++y)
             {
-                image.pixels[(y * image.sx + x) * 3] =
-                    blurredRed->pixels[y * image.sx + x];
-                image.pixels[(y * image.sx + x) * 3 + 1] =
-                    blurredGreen->pixels[y * image.sx + x];
-                image.pixels[(y * image.sx + x) * 3 + 2] =
-                    blurredBlue->pixels[y * image.sx + x];
+                for (int x = 0; x < image.sx; ++x)
+                {
+                    image.pixels[(y * image.sx + x) * 3] =
+                        blurredRed->pixels[y * image.sx + x];
+                    image.pixels[(y * image.sx + x) * 3 + 1] =
+                        blurredGreen->pixels[y * image.sx + x];
+                    image.pixels[(y * image.sx + x) * 3 + 2] =
+                        blurredBlue->pixels[y * image.sx + x];
+                }
             }
-        }
+        });
 
         delete blurredRed;
         delete blurredGreen;
@@ -359,22 +306,17 @@ namespace tifo
 
     void glow_filter(rgb24_image& image, float blur_radius, int threshold)
     {
-        auto tmp = new rgb24_image(image);
+        // Layer recipe: the blurred image, above the threshold, added on top
+        auto glow = std::make_shared<rgb24_image>(image);
 
-        rgb_gaussian(*tmp, 5, blur_radius);
+        rgb_gaussian(*glow, 5, blur_radius);
 
-        int px;
-        for (int i = 0; i < image.sx * image.sy * 3; i++)
-        {
-            if (tmp->pixels[i] < threshold)
-                px = 0;
-            else
-                px = tmp->pixels[i] - threshold;
-
-            image.pixels[i] = std::min(image.pixels[i] + px, 255);
-        }
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin * image.sx * 3; i < end * image.sx * 3; i++)
+                glow->pixels[i] = std::max(glow->pixels[i] - threshold, 0);
+        });
 
-        delete tmp;
+        flatten_layers(image, { { glow, blend_mode::add, 1.0f, nullptr } });
     }
 
 } // namespace tifo
\ No newline at end of file
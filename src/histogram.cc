@@ -1,17 +1,158 @@
 #include "histogram.hh"
+#include <array>
 #include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "scheduler.hh"
 
 namespace tifo {
-    histogram_1d* make_histogram(gray8_image& image, int limit)
+    namespace {
+        // Sub-histograms of each band, as unrolled in count_values
+        constexpr int copies = 4;
+
+        // Runs count_row(y, counts) over the rows of rect, counts holding
+        // copies sub-histograms for each of the tables, and sums them.
+        template <int tables, typename Count>
+        std::array<histogram_1d, tables> count_rows(const image_rect& rect,
+                                                    Count count_row)
+        {
+            std::array<histogram_1d, tables> result{};
+            if (rect.empty())
+                return result;
+
+            std::mutex lock;
+            parallel_rows(rect.y1 - rect.y0, [&](int begin, int end) {
+                std::vector<unsigned int> counts(
+                    tables * copies * IMAGE_NB_LEVELS, 0);
+                for (int y = rect.y0 + begin; y < rect.y0 + end; y++)
+                    count_row(y, counts.data());
+
+                std::lock_guard<std::mutex> guard(lock);
+                for (int t = 0; t < tables; t++)
+                {
+                    for (int c = 0; c < copies; c++)
+                    {
+                        const unsigned int* sub = counts.data()
+                            + (t * copies + c) * IMAGE_NB_LEVELS;
+                        for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+                            result[t].histogram[level] += sub[level];
+                    }
+                }
+            });
+
+            return result;
+        }
+
+        // Counts n values step bytes apart in the sub-histograms of counts
+        inline void count_values(const uint8_t* values, int n, int step,
+                                 unsigned int* counts)
+        {
+            unsigned int* sub0 = counts;
+            unsigned int* sub1 = counts + IMAGE_NB_LEVELS;
+            unsigned int* sub2 = counts + 2 * IMAGE_NB_LEVELS;
+            unsigned int* sub3 = counts + 3 * IMAGE_NB_LEVELS;
+
+            int i = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                sub0[values[i * step]]++;
+                sub1[values[(i + 1) * step]]++;
+                sub2[values[(i + 2) * step]]++;
+                sub3[values[(i + 3) * step]]++;
+            }
+            for (; i < n; i++)
+                sub0[values[i * step]]++;
+        }
+
+        image_rect clipped(const image_rect& rect, int sx, int sy)
+        {
+            return rect.intersected({ 0, 0, sx, sy });
+        }
+    }
+
+    histogram_1d gray_histogram(const gray8_image& image)
     {
-        auto hist = new histogram_1d;
-        for (int i = 0; i < limit + 1; i++)
-            hist->histogram[i] = 0;
-        GRAY8 pixels = image.get_buffer();
-        int length = image.length;
-        for (int i = 0; i < length; i++)
-            hist->histogram[pixels[i]]++;
-        return hist;
+        return gray_histogram(image, { 0, 0, image.sx, image.sy });
+    }
+
+    histogram_1d gray_histogram(const gray8_image& image,
+                                const image_rect& rect)
+    {
+        auto area = clipped(rect, image.sx, image.sy);
+        return count_rows<1>(area, [&](int y, unsigned int* counts) {
+            count_values(image.pixels + y * image.sx + area.x0,
+                         area.x1 - area.x0, 1, counts);
+        })[0];
+    }
+
+    histogram_1d channel_histogram(const rgb24_image& image, int channel)
+    {
+        return channel_histogram(image, channel,
+                                 { 0, 0, image.sx, image.sy });
+    }
+
+    histogram_1d channel_histogram(const rgb24_image& image, int channel,
+                                   const image_rect& rect)
+    {
+        auto area = clipped(rect, image.sx, image.sy);
+        return count_rows<1>(area, [&](int y, unsigned int* counts) {
+            count_values(image.pixels + (y * image.sx + area.x0) * 3 + channel,
+                         area.x1 - area.x0, 3, counts);
+        })[0];
+    }
+
+    histogram_1d luma_histogram(const rgb24_image& image,
+                                const image_rect& rect)
+    {
+        auto area = clipped(rect, image.sx, image.sy);
+        return count_rows<1>(area, [&](int y, unsigned int* counts) {
+            const uint8_t* row = image.pixels + (y * image.sx + area.x0) * 3;
+            int n = area.x1 - area.x0;
+
+            for (int x = 0; x < n; x++)
+            {
+                const uint8_t* pixel = row + x * 3;
+                counts[(x % copies) * IMAGE_NB_LEVELS
+                       + (pixel[0] + pixel[1] + pixel[2]) / 3]++;
+            }
+        })[0];
+    }
+
+    rgb_histogram rgb_histograms(const rgb24_image& image)
+    {
+        return rgb_histograms(image, { 0, 0, image.sx, image.sy });
+    }
+
+    rgb_histogram rgb_histograms(const rgb24_image& image,
+                                 const image_rect& rect)
+    {
+        auto area = clipped(rect, image.sx, image.sy);
+        auto tables = count_rows<4>(area, [&](int y, unsigned int* counts) {
+            const uint8_t* row = image.pixels + (y * image.sx + area.x0) * 3;
+            int n = area.x1 - area.x0;
+
+            for (int x = 0; x < n; x++)
+            {
+                const uint8_t* pixel = row + x * 3;
+                unsigned int* sub = counts + (x % copies) * IMAGE_NB_LEVELS;
+                int luma = (pixel[0] + pixel[1] + pixel[2]) / 3;
+
+                sub[pixel[0]]++;
+                sub[copies * IMAGE_NB_LEVELS + pixel[1]]++;
+                sub[2 * copies * IMAGE_NB_LEVELS + pixel[2]]++;
+                sub[3 * copies * IMAGE_NB_LEVELS + luma]++;
+            }
+        });
+
+        return { tables[0], tables[1], tables[2], tables[3] };
+    }
+
+    histogram_1d* make_histogram(gray8_image& image, int)
+    {
+        return new histogram_1d(gray_histogram(image));
     }
 
     void save_hist(histogram_1d& hist, const char* path)
@@ -21,6 +162,19 @@ namespace tifo {
             file << hist.histogram[i] << "\n";
     }
 
+    histogram_1d load_hist(const char* path)
+    {
+        std::ifstream file(path);
+        histogram_1d hist;
+        for (int i = 0; i < 256; i++)
+        {
+            if (!(file >> hist.histogram[i]))
+                throw std::runtime_error(
+                    std::string("Cannot read the histogram ") + path);
+        }
+        return hist;
+    }
+
     histogram_1d* cumulative_hist(histogram_1d& hist, int limit)
     {
         auto cumulative = new histogram_1d;
@@ -2,15 +2,55 @@
 #define	HISTOGRAM_HH
 
 #include "image.hh"
+#include "region.hh"
 #include <fstream>
 
 namespace tifo {
 
     typedef struct { unsigned int histogram[IMAGE_NB_LEVELS]; } histogram_1d;
 
+    /**
+     * Histogram of the sx * sy pixels of the image. limit is only kept for
+     * the callers: levels above it are counted too.
+     */
     histogram_1d* make_histogram(gray8_image& image, int limit);
     void save_hist(histogram_1d& hist, const char* path);
+    /** Histogram written by save_hist. */
+    histogram_1d load_hist(const char* path);
     histogram_1d* cumulative_hist(histogram_1d& hist, int limit);
+
+    /** Histograms of the three channels and of the gray level (R+G+B)/3. */
+    struct rgb_histogram
+    {
+        histogram_1d red;
+        histogram_1d green;
+        histogram_1d blue;
+        histogram_1d luma;
+    };
+
+    /*
+     * Counting is split in bands of rows over the threads. Each band counts
+     * consecutive pixels in interleaved sub-histograms, so that runs of one
+     * level do not wait on their own increments, and merges them at the
+     * end. The rectangle is clipped to the image.
+     */
+    histogram_1d gray_histogram(const gray8_image& image);
+    histogram_1d gray_histogram(const gray8_image& image,
+                                const image_rect& rect);
+
+    /** Histogram of one channel, such as V in an HSV image. */
+    histogram_1d channel_histogram(const rgb24_image& image, int channel);
+    histogram_1d channel_histogram(const rgb24_image& image, int channel,
+                                   const image_rect& rect);
+
+    /** Histogram of the gray level (R+G+B)/3 alone. */
+    histogram_1d luma_histogram(const rgb24_image& image,
+                                const image_rect& rect);
+
+    /** All the histograms of rgb_histogram in one pass. */
+    rgb_histogram rgb_histograms(const rgb24_image& image);
+    rgb_histogram rgb_histograms(const rgb24_image& image,
+                                 const image_rect& rect);
 }
 
 #endif
\ No newline at end of file
@@ -1,72 +1,279 @@
 #include "histogram_operations.hh"
 
+#include <algorithm>
+#include <cmath>
+
+#include "scheduler.hh"
+
 namespace tifo
 {
-    void equalize(gray8_image& image, histogram_1d& hist, int b_sup)
+    level_table equalize_table(const histogram_1d& hist, int b_sup)
     {
-        histogram_1d* cumul = cumulative_hist(hist, b_sup);
+        level_table table{};
 
-        int nb_pix = image.length;
+        unsigned long total = 0;
+        for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+            total += hist.histogram[level];
+        if (total == 0)
+            return table;
 
-        for (int i = 0; i < image.length; i++)
+        unsigned long cumul = 0;
+        for (int level = 0; level < IMAGE_NB_LEVELS; level++)
         {
-            image.pixels[i] = (uint8_t)round(
-                static_cast<float>(b_sup * cumul->histogram[image.pixels[i]])
-                / static_cast<float>(nb_pix));
+            cumul += hist.histogram[level];
+            table[level] = std::round((double)b_sup * cumul / total);
         }
+
+        return table;
     }
 
-    rgb24_image* rgb_equalize(rgb24_image& image)
+    level_table stretch_table(int low, int high)
     {
-        std::vector<gray8_image*> colors = rgb_to_gray_color(image);
-        histogram_1d* red_hist = make_histogram(*colors.at(0), 255);
-        histogram_1d* green_hist = make_histogram(*colors.at(1), 255);
-        histogram_1d* blue_hist = make_histogram(*colors.at(2), 255);
+        level_table table;
+        for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+        {
+            if (high <= low)
+                table[level] = level < low ? 0 : IMAGE_MAX_LEVEL;
+            else
+                table[level] = std::clamp(
+                    (int)std::lround((level - low) * (double)IMAGE_MAX_LEVEL
+                                     / (high - low)),
+                    0, IMAGE_MAX_LEVEL);
+        }
 
-        std::vector<gray8_image*> new_colors;
+        return table;
+    }
 
-        equalize(*colors.at(0), *red_hist, 255);
-        equalize(*colors.at(1), *green_hist, 255);
-        equalize(*colors.at(2), *blue_hist, 255);
+    level_table match_table(const histogram_1d& hist,
+                            const histogram_1d& reference)
+    {
+        unsigned long long total = 0;
+        unsigned long long reference_total = 0;
+        for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+        {
+            total += hist.histogram[level];
+            reference_total += reference.histogram[level];
+        }
 
-        new_colors.push_back(colors.at(0));
-        new_colors.push_back(colors.at(1));
-        new_colors.push_back(colors.at(2));
+        level_table table;
+        if (total == 0 || reference_total == 0)
+        {
+            for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+                table[level] = level;
+            return table;
+        }
 
-        rgb24_image* new_image = gray_to_rgb_color(new_colors);
+        // Both cumulative histograms only grow: one walk over each
+        unsigned long long cumul = 0;
+        unsigned long long reference_cumul = reference.histogram[0];
+        int target = 0;
+        for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+        {
+            cumul += hist.histogram[level];
+            // cumul / total <= reference_cumul / reference_total
+            while (target < IMAGE_MAX_LEVEL
+                   && reference_cumul * total < cumul * reference_total)
+                reference_cumul += reference.histogram[++target];
+            table[level] = target;
+        }
 
-        return new_image;
+        return table;
     }
 
-    hsv24_image* hsv_equalize(hsv24_image& image)
+    int percentile(const histogram_1d& hist, float percent)
     {
-        std::vector<gray8_image*> colors = hsv_to_gray_color(image);
-        histogram_1d* h_hist = make_histogram(*colors.at(2), 100);
+        unsigned long total = 0;
+        for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+            total += hist.histogram[level];
 
-        std::vector<gray8_image*> new_colors;
+        double wanted = total * std::clamp(percent, 0.0f, 100.0f) / 100;
+        unsigned long cumul = 0;
+        for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+        {
+            cumul += hist.histogram[level];
+            if (cumul > 0 && cumul >= wanted)
+                return level;
+        }
 
-        new_colors.push_back(colors.at(0));
-        new_colors.push_back(colors.at(1));
-        equalize(*colors.at(2), *h_hist, 100);
-        new_colors.push_back(colors.at(2));
+        return IMAGE_MAX_LEVEL;
+    }
 
-        hsv24_image* new_image = gray_to_hsv_color(new_colors);
+    void apply_table(rgb24_image& image, const level_table& table)
+    {
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin * image.sx * 3; i < end * image.sx * 3; i++)
+                image.pixels[i] = table[image.pixels[i]];
+        });
+    }
 
-        return new_image;
+    void apply_table(rgb24_image& image, int channel,
+                     const level_table& table)
+    {
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin * image.sx * 3 + channel;
+                 i < end * image.sx * 3; i += 3)
+                image.pixels[i] = table[image.pixels[i]];
+        });
     }
 
-    void yCrCb_equalize(yCrCb24_image& image)
+    void apply_tables(rgb24_image& image, const level_table& red,
+                      const level_table& green, const level_table& blue)
     {
-        auto colors = rgb_to_gray_color(image);
-        auto hist = make_histogram(*colors[0], 255);
-        equalize(*colors[0], *hist, 255);
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin * image.sx * 3; i < end * image.sx * 3; i += 3)
+            {
+                image.pixels[i] = red[image.pixels[i]];
+                image.pixels[i + 1] = green[image.pixels[i + 1]];
+                image.pixels[i + 2] = blue[image.pixels[i + 2]];
+            }
+        });
+    }
 
-        for (int i = 0; i < image.sx * image.sy; i++)
+    namespace
+    {
+        // 1 / n in 1/2^24, for n up to the sum of the three channels
+        const auto reciprocals = [] {
+            std::array<uint32_t, 3 * IMAGE_MAX_LEVEL + 1> table{};
+            for (uint32_t n = 1; n < table.size(); n++)
+                table[n] = ((1u << 24) + n / 2) / n;
+            return table;
+        }();
+
+        // Gains are in 1/2^16
+        constexpr int gain_shift = 16;
+
+        // Gives the pixel of the given sum the one wanted, in 1/luma_one,
+        // gain being their ratio in 1/2^gain_shift
+        inline void scale_pixel(uint8_t* pixel, int sum, int target,
+                                int gain)
+        {
+            constexpr int half = 1 << (gain_shift - 1);
+            int brightest = std::max({ pixel[0], pixel[1], pixel[2] });
+            if ((int64_t)brightest * gain
+                < (IMAGE_MAX_LEVEL << gain_shift) + half)
+            {
+                for (int c = 0; c < 3; c++)
+                    pixel[c] = (pixel[c] * gain + half) >> gain_shift;
+                return;
+            }
+
+            // The brightest channel clips: the sum still missing comes from
+            // white, which lowers the saturation but not the hue
+            gain = (IMAGE_MAX_LEVEL * reciprocals[brightest]) >> 8;
+            int scaled = sum * gain;
+            int missing =
+                std::max(0, target * ((1 << gain_shift) / luma_one) - scaled);
+            int room = std::max(
+                1, (3 * (IMAGE_MAX_LEVEL << gain_shift) - scaled + half)
+                    >> gain_shift);
+            int64_t white = std::min<int64_t>(
+                1 << gain_shift, ((int64_t)missing * reciprocals[room]) >> 24);
+
+            for (int c = 0; c < 3; c++)
+            {
+                int64_t value = pixel[c] * gain;
+                value += (((int64_t)IMAGE_MAX_LEVEL << gain_shift) - value)
+                    * white >> gain_shift;
+                pixel[c] = std::min<int64_t>(IMAGE_MAX_LEVEL,
+                                             (value + half) >> gain_shift);
+            }
+        }
+
+        // Gain from a sum of the channels to a target sum in 1/luma_one
+        int luma_gain(int sum, int target)
+        {
+            return ((int64_t)target * reciprocals[sum]) >> 16;
+        }
+    } // namespace
+
+    void set_luma_pixels(uint8_t* pixels, const uint16_t* luma, int count)
+    {
+        for (int i = 0; i < count; i++, pixels += 3)
         {
-            image.pixels[i * 3] = colors[0]->pixels[i];
+            int sum = pixels[0] + pixels[1] + pixels[2];
+            if (luma[i] == sum / 3 * luma_one)
+                continue;
+            if (sum == 0)
+                pixels[0] = pixels[1] = pixels[2] =
+                    (luma[i] + luma_one / 2) / luma_one;
+            else
+                scale_pixel(pixels, sum, 3 * luma[i],
+                            luma_gain(sum, 3 * luma[i]));
         }
     }
 
+    void apply_luma_table(rgb24_image& image, const level_table& table)
+    {
+        // Everything but the clipping only depends on the sum of the
+        // channels: gains by sum, with markers for the levels that do not
+        // move and for black, which has no hue to scale
+        constexpr int unchanged = -1;
+        constexpr int from_black = -2;
+        std::array<int, 3 * IMAGE_MAX_LEVEL + 1> gains;
+        for (int sum = 0; sum < (int)gains.size(); sum++)
+        {
+            int level = sum / 3;
+            gains[sum] = table[level] == level ? unchanged
+                : sum == 0                      ? from_black
+                    : luma_gain(sum, 3 * table[level] * luma_one);
+        }
+
+        parallel_rows(image.sy, [&](int begin, int end) {
+            uint8_t* pixel = image.pixels + begin * image.sx * 3;
+            uint8_t* last = image.pixels + end * image.sx * 3;
+            for (; pixel < last; pixel += 3)
+            {
+                int sum = pixel[0] + pixel[1] + pixel[2];
+                int gain = gains[sum];
+                if (gain >= 0)
+                    scale_pixel(pixel, sum, 3 * table[sum / 3] * luma_one,
+                                gain);
+                else if (gain == from_black)
+                    pixel[0] = pixel[1] = pixel[2] = table[0];
+            }
+        });
+    }
+
+    rgb24_image* rgb_equalize(rgb24_image& image)
+    {
+        auto hist = rgb_histograms(image);
+        auto new_image = new rgb24_image(image);
+
+        apply_tables(*new_image, equalize_table(hist.red, 255),
+                     equalize_table(hist.green, 255),
+                     equalize_table(hist.blue, 255));
+
+        return new_image;
+    }
+
+    hsv24_image* hsv_equalize(hsv24_image& image)
+    {
+        auto new_image = new hsv24_image(image);
+        apply_table(*new_image, 2,
+                    equalize_table(channel_histogram(image, 2), 100));
+        return new_image;
+    }
+
+    void yCrCb_equalize(yCrCb24_image& image)
+    {
+        apply_table(image, 0,
+                    equalize_table(channel_histogram(image, 0), 255));
+    }
+
+    void luma_equalize(rgb24_image& image)
+    {
+        apply_luma_table(image,
+                         equalize_table(rgb_histograms(image).luma, 255));
+    }
+
+    void auto_levels(rgb24_image& image, float clip)
+    {
+        auto luma = rgb_histograms(image).luma;
+        apply_luma_table(image,
+                         stretch_table(percentile(luma, clip),
+                                       percentile(luma, 100 - clip)));
+    }
+
     int find_min(histogram_1d& hist, int limit)
     {
         unsigned int min = hist.histogram[0];
@@ -96,38 +303,52 @@ namespace tifo
         return i_max;
     }
 
-    gray8_image* etirement(gray8_image& image, histogram_1d& hist, int limit)
+    level_table etirement_table(histogram_1d& hist, int limit)
     {
-        gray8_image* new_image = new gray8_image(image.sx, image.sy);
+        level_table table;
 
         int b_sup = find_max(hist, limit);
         int b_inf = find_min(hist, limit);
         int new_max = 100;
         int new_min = 0;
 
-        for (int i = 0; i < image.length; i++)
+        for (int level = 0; level < IMAGE_NB_LEVELS; level++)
         {
-            int new_pixel = (image.pixels[i] - b_inf) * ((new_max - new_min) / (double)(b_sup - b_inf)) + new_min;
+            if (b_sup == b_inf)
+            {
+                table[level] = std::min(level, new_max);
+                continue;
+            }
+
+            int new_pixel = (level - b_inf)
+                    * ((new_max - new_min) / (double)(b_sup - b_inf))
+                + new_min;
             float scale = (new_pixel * limit) / 255;
-            new_image->pixels[i] = std::max(0, std::min(100, (int)scale));
+            table[level] = std::max(0, std::min(100, (int)scale));
         }
 
-        return new_image;
+        return table;
     }
 
     hsv24_image* hsv_etirement(hsv24_image& image)
     {
-        std::vector<gray8_image*> colors = hsv_to_gray_color(image);
-        histogram_1d* h_hist = make_histogram(*colors.at(2), 100);
-
-        std::vector<gray8_image*> new_colors;
-
-        new_colors.push_back(colors.at(0));
-        new_colors.push_back(colors.at(1));
-        new_colors.push_back(etirement(*colors.at(2), *h_hist, 100));
+        auto v_hist = channel_histogram(image, 2);
+        auto new_image = new hsv24_image(image);
+        apply_table(*new_image, 2, etirement_table(v_hist, 100));
+        return new_image;
+    }
 
-        hsv24_image* new_image = gray_to_hsv_color(new_colors);
+    void match_luma(rgb24_image& image, const histogram_1d& reference)
+    {
+        apply_luma_table(image,
+                         match_table(rgb_histograms(image).luma, reference));
+    }
 
-        return new_image;
+    void match_channels(rgb24_image& image, const rgb_histogram& reference)
+    {
+        auto hist = rgb_histograms(image);
+        apply_tables(image, match_table(hist.red, reference.red),
+                     match_table(hist.green, reference.green),
+                     match_table(hist.blue, reference.blue));
     }
-}
\ No newline at end of file
+}
@@ -4,11 +4,68 @@
 #ifndef TIFO_PROJECT_HISTOGRAM_OPERATIONS_HH
 #define TIFO_PROJECT_HISTOGRAM_OPERATIONS_HH
 
+#include <array>
+
 namespace tifo
 {
+    /** New value of each level. */
+    typedef std::array<uint8_t, IMAGE_NB_LEVELS> level_table;
+
+    /** Equalization to [0, b_sup] from the cumulative histogram. */
+    level_table equalize_table(const histogram_1d& hist, int b_sup);
+    /** Linear stretch of [low, high] to [0, 255], clamped outside. */
+    level_table stretch_table(int low, int high);
+    /**
+     * Histogram specification: maps each level to the lowest one of the
+     * reference with at least the same share of pixels at or below it.
+     */
+    level_table match_table(const histogram_1d& hist,
+                            const histogram_1d& reference);
+    /** Lowest level with at least percent % of the pixels at or below it. */
+    int percentile(const histogram_1d& hist, float percent);
+
+    /*
+     * The tables are applied in place, in one pass over the interleaved
+     * pixels.
+     */
+    void apply_table(rgb24_image& image, const level_table& table);
+    void apply_table(rgb24_image& image, int channel,
+                     const level_table& table);
+    void apply_tables(rgb24_image& image, const level_table& red,
+                      const level_table& green, const level_table& blue);
+
+    /** Fractions of a level of the gray levels given to set_luma_pixels. */
+    constexpr int luma_one = 256;
+    /**
+     * Gives each of the count pixels the gray level luma[i] / luma_one, as
+     * (r + g + b) / 3, keeping its hue: the three channels are scaled
+     * together, and mixed with white once the brightest one would clip.
+     * Fixed point only, with a table of reciprocals.
+     */
+    void set_luma_pixels(uint8_t* pixels, const uint16_t* luma, int count);
+    /**
+     * Maps the gray level of each pixel through the table, as
+     * set_luma_pixels does.
+     */
+    void apply_luma_table(rgb24_image& image, const level_table& table);
+
+    rgb24_image* rgb_equalize(rgb24_image& image);
     hsv24_image* hsv_etirement(hsv24_image& image);
     hsv24_image* hsv_equalize(hsv24_image& image);
     void yCrCb_equalize(yCrCb24_image& image);
+
+    /** Equalizes the gray level, keeping the hues. */
+    void luma_equalize(rgb24_image& image);
+    /**
+     * Stretches the gray levels between the clip and 100 - clip
+     * percentiles to the full range, keeping the hues.
+     */
+    void auto_levels(rgb24_image& image, float clip);
+
+    /** Matches the gray levels to the reference histogram, keeping the hues. */
+    void match_luma(rgb24_image& image, const histogram_1d& reference);
+    /** Matches each channel to the reference histogram of that channel. */
+    void match_channels(rgb24_image& image, const rgb_histogram& reference);
 }
 
 #endif //TIFO_PROJECT_HISTOGRAM_OPERATIONS_HH
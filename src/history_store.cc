@@ -0,0 +1,553 @@
+#include "history_store.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "scheduler.hh"
+
+namespace tifo
+{
+    namespace
+    {
+        // Rows encoded together, bands are encoded and decoded in parallel
+        constexpr int band_rows = 64;
+
+        // Runs of 3 to 130 equal bytes are stored as (length + 125, byte),
+        // other bytes as (count - 1, bytes...) by groups of up to 128.
+        void rle_encode(const uint8_t* in, std::size_t n,
+                        std::vector<uint8_t>& out)
+        {
+            std::size_t i = 0;
+            while (i < n)
+            {
+                std::size_t run = 1;
+                while (i + run < n && run < 130 && in[i + run] == in[i])
+                    run++;
+
+                if (run >= 3)
+                {
+                    out.push_back(run + 125);
+                    out.push_back(in[i]);
+                    i += run;
+                    continue;
+                }
+
+                std::size_t start = i;
+                while (i < n && i - start < 128
+                       && !(i + 2 < n && in[i] == in[i + 1]
+                            && in[i] == in[i + 2]))
+                    i++;
+
+                out.push_back(i - start - 1);
+                out.insert(out.end(), in + start, in + i);
+            }
+        }
+
+        void rle_decode(const uint8_t* in, uint8_t* out, std::size_t n)
+        {
+            std::size_t i = 0;
+            while (i < n)
+            {
+                int control = *in++;
+                if (control < 128)
+                {
+                    std::memcpy(out + i, in, control + 1);
+                    in += control + 1;
+                    i += control + 1;
+                }
+                else
+                {
+                    std::memset(out + i, *in++, control - 125);
+                    i += control - 125;
+                }
+            }
+        }
+    } // namespace
+
+    bool history_store::entry::small_change() const
+    {
+        long area = dirty.area();
+        return area > 0 && 2 * area <= (long)sx * sy;
+    }
+
+    history_store::history_store(std::size_t budget_bytes)
+        : budget(budget_bytes)
+    {}
+
+    history_store::~history_store()
+    {
+        if (scratch)
+            std::fclose(scratch);
+    }
+
+    std::size_t history_store::size() const
+    {
+        return entries.size();
+    }
+
+    bool history_store::empty() const
+    {
+        return entries.empty();
+    }
+
+    std::uint64_t history_store::id(std::size_t i) const
+    {
+        return entries[i].id;
+    }
+
+    bool history_store::contains(std::size_t i) const
+    {
+        auto& e = entries[i];
+        return e.image || e.file_offset >= 0 || !e.data.empty();
+    }
+
+    std::shared_ptr<const rgb24_image> history_store::get(std::size_t i)
+    {
+        auto image = load(i);
+        entries[i].last_use = ++clock;
+        enforce_budget();
+        return image;
+    }
+
+    void history_store::push(std::shared_ptr<const rgb24_image> image,
+                             std::optional<image_rect> changed)
+    {
+        entries.emplace_back();
+        set(entries.size() - 1, std::move(image), changed);
+    }
+
+    void history_store::set(std::size_t i,
+                            std::shared_ptr<const rgb24_image> image,
+                            std::optional<image_rect> changed)
+    {
+        // The previous state may be encoded against the one replaced, and
+        // the next one may be a rectangle over it
+        if (i > 0 && entries[i - 1].delta)
+            load(i - 1);
+        if (i + 1 < entries.size())
+        {
+            if (entries[i + 1].patch)
+                load(i + 1);
+            entries[i + 1].dirty = image_rect();
+        }
+
+        auto& e = entries[i];
+        forget(e);
+        e = entry();
+        e.id = ++last_id;
+        e.last_use = ++clock;
+        if (image)
+        {
+            e.sx = image->sx;
+            e.sy = image->sy;
+            e.image = std::move(image);
+
+            bool same_size = i > 0 && entries[i - 1].sx == e.sx
+                && entries[i - 1].sy == e.sy;
+            if (same_size && changed)
+                e.dirty = changed->intersected({ 0, 0, e.sx, e.sy });
+            else if (same_size && entries[i - 1].image)
+                e.dirty = changed_rect(*entries[i - 1].image, *e.image);
+        }
+        account(e);
+
+        enforce_budget();
+    }
+
+    void history_store::restore(std::size_t i,
+                                std::shared_ptr<const rgb24_image> image)
+    {
+        // Same image as before: the next state's rectangle is still valid
+        auto id = entries[i].id;
+        image_rect next;
+        if (i + 1 < entries.size())
+            next = entries[i + 1].dirty;
+
+        set(i, std::move(image));
+
+        entries[i].id = id;
+        if (i + 1 < entries.size())
+            entries[i + 1].dirty = next;
+    }
+
+    void history_store::drop(std::size_t i)
+    {
+        if (i > 0 && entries[i - 1].delta)
+            load(i - 1);
+        if (i + 1 < entries.size() && entries[i + 1].patch)
+            load(i + 1);
+
+        auto& e = entries[i];
+        forget(e);
+        e.image.reset();
+        e.data = std::vector<std::uint8_t>();
+        e.bands.clear();
+        e.encoded_size = 0;
+        e.file_offset = -1;
+        e.delta = false;
+    }
+
+    void history_store::truncate(std::size_t count)
+    {
+        if (count >= entries.size())
+            return;
+
+        if (count > 0 && entries[count - 1].delta)
+            load(count - 1);
+        for (std::size_t i = count; i < entries.size(); i++)
+            forget(entries[i]);
+        entries.resize(count);
+    }
+
+    void history_store::clear()
+    {
+        entries.clear();
+        resident_uses.clear();
+        resident_bytes = 0;
+        compressed_bytes = 0;
+
+        // Spilled states are never rewritten: start a new file
+        if (scratch)
+        {
+            std::fclose(scratch);
+            scratch = nullptr;
+        }
+    }
+
+    void history_store::set_budget(std::size_t bytes)
+    {
+        budget = bytes;
+        enforce_budget();
+    }
+
+    history_stats history_store::stats() const
+    {
+        history_stats stats;
+        stats.states = entries.size();
+        stats.budget_bytes = budget;
+
+        std::unordered_set<const rgb24_image*> counted;
+        for (auto& e : entries)
+        {
+            if (e.image)
+            {
+                stats.resident++;
+                if (counted.insert(e.image.get()).second)
+                    stats.resident_bytes += e.image->length;
+            }
+            else if (e.file_offset >= 0)
+            {
+                stats.spilled++;
+                stats.spilled_bytes += e.encoded_size;
+            }
+            else if (!e.data.empty())
+            {
+                stats.compressed++;
+                stats.compressed_bytes += e.encoded_size;
+                if (e.patch)
+                    stats.patches++;
+            }
+        }
+
+        return stats;
+    }
+
+    std::size_t history_store::memory_bytes() const
+    {
+        return resident_bytes + compressed_bytes;
+    }
+
+    // Same classes as stats(): an entry holds its image, or its encoded
+    // data in memory, or nothing in memory once spilled
+    void history_store::forget(const entry& e)
+    {
+        if (e.image)
+        {
+            auto uses = resident_uses.find(e.image.get());
+            if (--uses->second == 0)
+            {
+                resident_bytes -= e.image->length;
+                resident_uses.erase(uses);
+            }
+        }
+        else if (e.file_offset < 0 && !e.data.empty())
+        {
+            compressed_bytes -= e.encoded_size;
+        }
+    }
+
+    void history_store::account(const entry& e)
+    {
+        if (e.image)
+        {
+            if (resident_uses[e.image.get()]++ == 0)
+                resident_bytes += e.image->length;
+        }
+        else if (e.file_offset < 0 && !e.data.empty())
+        {
+            compressed_bytes += e.encoded_size;
+        }
+    }
+
+    void history_store::read_spilled(entry& e)
+    {
+        if (e.file_offset < 0)
+            return;
+
+        e.data.resize(e.encoded_size);
+        if (std::fseek(scratch, e.file_offset, SEEK_SET) != 0
+            || std::fread(e.data.data(), 1, e.encoded_size, scratch)
+                != e.encoded_size)
+            throw std::runtime_error("Cannot read the history file");
+    }
+
+    std::shared_ptr<const rgb24_image> history_store::load(std::size_t i)
+    {
+        if (entries[i].image || !contains(i))
+            return entries[i].image;
+
+        if (entries[i].patch)
+        {
+            auto previous = load(i - 1);
+
+            auto& e = entries[i];
+            read_spilled(e);
+
+            auto image = std::make_shared<rgb24_image>(*previous);
+            int row_bytes = (e.dirty.x1 - e.dirty.x0) * 3;
+            for (int y = e.dirty.y0; y < e.dirty.y1; y++)
+                std::memcpy(image->pixels + (y * e.sx + e.dirty.x0) * 3,
+                            e.data.data() + (y - e.dirty.y0) * row_bytes,
+                            row_bytes);
+
+            forget(e);
+            e.image = std::move(image);
+            e.data = std::vector<std::uint8_t>();
+            e.encoded_size = 0;
+            e.file_offset = -1;
+            e.patch = false;
+            account(e);
+
+            return e.image;
+        }
+
+        std::shared_ptr<const rgb24_image> next;
+        if (entries[i].delta)
+            next = load(i + 1);
+
+        auto& e = entries[i];
+        read_spilled(e);
+
+        auto image = std::make_shared<rgb24_image>(e.sx, e.sy);
+        int row_bytes = e.sx * 3;
+        int nb_bands = (e.sy + band_rows - 1) / band_rows;
+
+        parallel_rows(nb_bands, [&](int begin, int end) {
+            for (int band = begin; band < end; band++)
+            {
+                int y0 = band * band_rows;
+                int y1 = std::min(e.sy, y0 + band_rows);
+                uint8_t* out = image->pixels + y0 * row_bytes;
+
+                rle_decode(e.data.data() + e.bands[band], out,
+                           (y1 - y0) * row_bytes);
+
+                if (next)
+                {
+                    const uint8_t* ref = next->pixels + y0 * row_bytes;
+                    for (int k = 0; k < (y1 - y0) * row_bytes; k++)
+                        out[k] += ref[k];
+                }
+                else
+                {
+                    for (int y = y0; y < y1; y++, out += row_bytes)
+                    {
+                        for (int x = 3; x < row_bytes; x++)
+                            out[x] += out[x - 3];
+                    }
+                }
+            }
+        });
+
+        forget(e);
+        e.image = std::move(image);
+        e.data = std::vector<std::uint8_t>();
+        e.bands.clear();
+        e.encoded_size = 0;
+        e.file_offset = -1;
+        e.delta = false;
+        account(e);
+
+        return e.image;
+    }
+
+    void history_store::compress(std::size_t i)
+    {
+        auto& e = entries[i];
+        auto& image = *e.image;
+
+        // Undo walks back from the current state: the next one is usually
+        // still decoded when this one is needed again. It must not be stored
+        // over this one though.
+        const rgb24_image* next = nullptr;
+        if (i + 1 < entries.size() && entries[i + 1].image
+            && !entries[i + 1].small_change() && entries[i + 1].sx == e.sx
+            && entries[i + 1].sy == e.sy)
+            next = entries[i + 1].image.get();
+
+        int row_bytes = e.sx * 3;
+        int nb_bands = (e.sy + band_rows - 1) / band_rows;
+        std::vector<std::vector<uint8_t>> encoded(nb_bands);
+
+        parallel_rows(nb_bands, [&](int begin, int end) {
+            std::vector<uint8_t> residual(band_rows * row_bytes);
+            for (int band = begin; band < end; band++)
+            {
+                int y0 = band * band_rows;
+                int y1 = std::min(e.sy, y0 + band_rows);
+                const uint8_t* in = image.pixels + y0 * row_bytes;
+
+                if (next)
+                {
+                    const uint8_t* ref = next->pixels + y0 * row_bytes;
+                    for (int k = 0; k < (y1 - y0) * row_bytes; k++)
+                        residual[k] = in[k] - ref[k];
+                }
+                else
+                {
+                    uint8_t* out = residual.data();
+                    for (int y = y0; y < y1; y++)
+                    {
+                        for (int x = 0; x < row_bytes; x++)
+                            out[x] = x < 3 ? in[x] : in[x] - in[x - 3];
+                        in += row_bytes;
+                        out += row_bytes;
+                    }
+                }
+
+                rle_encode(residual.data(), (y1 - y0) * row_bytes,
+                           encoded[band]);
+            }
+        });
+
+        std::size_t total = 0;
+        for (auto& band : encoded)
+            total += band.size();
+
+        forget(e);
+        e.data.clear();
+        e.data.reserve(total);
+        e.bands.resize(nb_bands);
+        for (int band = 0; band < nb_bands; band++)
+        {
+            e.bands[band] = e.data.size();
+            e.data.insert(e.data.end(), encoded[band].begin(),
+                          encoded[band].end());
+        }
+
+        e.encoded_size = total;
+        e.delta = next != nullptr;
+        e.image.reset();
+        account(e);
+    }
+
+    void history_store::make_patch(std::size_t i)
+    {
+        auto& e = entries[i];
+        int row_bytes = (e.dirty.x1 - e.dirty.x0) * 3;
+
+        forget(e);
+        e.data.resize((std::size_t)row_bytes * (e.dirty.y1 - e.dirty.y0));
+        for (int y = e.dirty.y0; y < e.dirty.y1; y++)
+            std::memcpy(e.data.data() + (y - e.dirty.y0) * row_bytes,
+                        e.image->pixels + (y * e.sx + e.dirty.x0) * 3,
+                        row_bytes);
+
+        e.encoded_size = e.data.size();
+        e.patch = true;
+        e.image.reset();
+        account(e);
+    }
+
+    bool history_store::spill(std::size_t i)
+    {
+        auto& e = entries[i];
+
+        if (!scratch)
+        {
+            scratch = std::tmpfile();
+            if (!scratch)
+            {
+                perror("Cannot create the history file");
+                return false;
+            }
+        }
+
+        if (std::fseek(scratch, 0, SEEK_END) != 0)
+            return false;
+
+        long offset = std::ftell(scratch);
+        if (std::fwrite(e.data.data(), 1, e.data.size(), scratch)
+            != e.data.size())
+        {
+            perror("Cannot write the history file");
+            return false;
+        }
+
+        forget(e);
+        e.file_offset = offset;
+        e.data = std::vector<std::uint8_t>();
+
+        return true;
+    }
+
+    void history_store::enforce_budget()
+    {
+        if (entries.empty())
+            return;
+
+        std::size_t hottest = 0;
+        for (std::size_t i = 1; i < entries.size(); i++)
+        {
+            if (entries[i].last_use > entries[hottest].last_use)
+                hottest = i;
+        }
+
+        while (memory_bytes() > budget)
+        {
+            // Compress the coldest state still decoded...
+            std::size_t victim = entries.size();
+            for (std::size_t i = 0; i < entries.size(); i++)
+            {
+                if (i != hottest && entries[i].image
+                    && (victim == entries.size()
+                        || entries[i].last_use < entries[victim].last_use))
+                    victim = i;
+            }
+
+            if (victim != entries.size())
+            {
+                if (victim > 0 && entries[victim].small_change()
+                    && contains(victim - 1))
+                    make_patch(victim);
+                else
+                    compress(victim);
+                continue;
+            }
+
+            // ...then move the coldest compressed one to disk
+            for (std::size_t i = 0; i < entries.size(); i++)
+            {
+                if (!entries[i].data.empty()
+                    && (victim == entries.size()
+                        || entries[i].last_use < entries[victim].last_use))
+                    victim = i;
+            }
+
+            if (victim == entries.size() || !spill(victim))
+                break;
+        }
+    }
+} // namespace tifo
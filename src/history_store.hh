@@ -0,0 +1,150 @@
+#ifndef TIFO_PROJECT_HISTORY_STORE_HH
+#define TIFO_PROJECT_HISTORY_STORE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "image.hh"
+#include "region.hh"
+
+namespace tifo
+{
+    /**
+     * Memory used by a history_store, by storage class.
+     */
+    struct history_stats
+    {
+        std::size_t states = 0;
+        std::size_t budget_bytes = 0;
+
+        std::size_t resident = 0;
+        std::size_t resident_bytes = 0;
+        std::size_t compressed = 0;
+        std::size_t compressed_bytes = 0;
+        /** Compressed states stored as a rectangle over the previous one. */
+        std::size_t patches = 0;
+        std::size_t spilled = 0;
+        std::size_t spilled_bytes = 0;
+    };
+
+    /**
+     * Undo history of an editing session, kept under a memory budget.
+     *
+     * States are immutable shared images: storing one keeps a reference on
+     * its buffer instead of a copy. Once the states in memory exceed the
+     * budget, the least recently used ones are compressed (difference with
+     * the next state when it is in memory, with the left pixel otherwise,
+     * then run length encoded) and, if that is not enough, moved to a
+     * scratch file. They are decoded back on access. The most recently
+     * accessed state always stays in memory.
+     *
+     * A state that only differs from the previous one in a small rectangle,
+     * found when it is stored, is compressed as that rectangle alone and
+     * pasted back over the previous state when decoded.
+     *
+     * A state may also be recorded without its image, when it is cheaper
+     * to compute again than to store: get() then returns null.
+     */
+    class history_store
+    {
+    public:
+        explicit history_store(std::size_t budget_bytes);
+        ~history_store();
+
+        history_store(const history_store&) = delete;
+        history_store& operator=(const history_store&) = delete;
+
+        std::size_t size() const;
+        bool empty() const;
+
+        /** Identifier of state i, never reused by the store. */
+        std::uint64_t id(std::size_t i) const;
+
+        /** Whether the image of state i is stored. */
+        bool contains(std::size_t i) const;
+
+        std::shared_ptr<const rgb24_image> get(std::size_t i);
+
+        /**
+         * changed bounds the pixels that differ from the previous state when
+         * the caller knows them, which saves comparing the two images.
+         */
+        void push(std::shared_ptr<const rgb24_image> image,
+                  std::optional<image_rect> changed = std::nullopt);
+        void set(std::size_t i, std::shared_ptr<const rgb24_image> image,
+                 std::optional<image_rect> changed = std::nullopt);
+
+        /** Stores the image of state i again, keeping its identifier. */
+        void restore(std::size_t i, std::shared_ptr<const rgb24_image> image);
+
+        /** Forgets the image of state i, keeping its identifier. */
+        void drop(std::size_t i);
+
+        /** Drops the states from count on. */
+        void truncate(std::size_t count);
+        void clear();
+
+        void set_budget(std::size_t bytes);
+        history_stats stats() const;
+
+    private:
+        struct entry
+        {
+            std::uint64_t id = 0;
+            std::uint64_t last_use = 0;
+            int sx = 0;
+            int sy = 0;
+
+            /** Decoded state, null once compressed. */
+            std::shared_ptr<const rgb24_image> image;
+
+            /** Encoded bands, empty when resident or spilled. */
+            std::vector<std::uint8_t> data;
+            /** Start of each band of rows in the encoded data. */
+            std::vector<std::size_t> bands;
+            std::size_t encoded_size = 0;
+            /** Position in the scratch file, -1 unless spilled. */
+            long file_offset = -1;
+            /** Encoded as a difference with the next state. */
+            bool delta = false;
+
+            /**
+             * Bounds of the pixels changed since the previous state, valid
+             * while that one is unchanged. Empty when not known.
+             */
+            image_rect dirty;
+            /** Encoded as the dirty rectangle over the previous state. */
+            bool patch = false;
+
+            bool small_change() const;
+        };
+
+        std::shared_ptr<const rgb24_image> load(std::size_t i);
+        void compress(std::size_t i);
+        void make_patch(std::size_t i);
+        void read_spilled(entry& e);
+        bool spill(std::size_t i);
+        void enforce_budget();
+        std::size_t memory_bytes() const;
+        /** Removes or adds the memory held by an entry to the counters. */
+        void forget(const entry& e);
+        void account(const entry& e);
+
+        std::vector<entry> entries;
+        /** Entries sharing each resident image, counted once in bytes. */
+        std::unordered_map<const rgb24_image*, std::size_t> resident_uses;
+        std::size_t resident_bytes = 0;
+        std::size_t compressed_bytes = 0;
+        std::size_t budget;
+        std::uint64_t last_id = 0;
+        std::uint64_t clock = 0;
+        std::FILE* scratch = nullptr;
+    };
+} // namespace tifo
+
+#endif //TIFO_PROJECT_HISTORY_STORE_HH
@@ -2,6 +2,9 @@
 #define IMAGE_HH
 
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 
 #define IMAGE_NB_LEVELS 256
@@ -86,8 +89,7 @@ namespace tifo
                 perror("aligned_alloc failed");
             }
 
-            for (int i = 0; i < sx * sy * 3; i++)
-                pixels[i] = other.pixels[i];
+            std::memcpy(pixels, other.pixels, sx * sy * 3);
         }
 
         /**
@@ -1,35 +1,42 @@
 #include "image_convert.hh"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <iostream>
 
+#include "scheduler.hh"
+
 namespace tifo
 {
     rgb24_image* gray_to_rgb_no_color(gray8_image& image)
     {
         auto rgb_image = new rgb24_image(image.sx, image.sy);
-        int j = 0;
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
-        {
-            rgb_image->pixels[i] = image.pixels[j];
-            rgb_image->pixels[i + 1] = image.pixels[j];
-            rgb_image->pixels[i + 2] = image.pixels[j];
-            j++;
-        }
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int j = begin * image.sx; j < end * image.sx; j++)
+            {
+                int i = j * 3;
+                rgb_image->pixels[i] = image.pixels[j];
+                rgb_image->pixels[i + 1] = image.pixels[j];
+                rgb_image->pixels[i + 2] = image.pixels[j];
+            }
+        });
         return rgb_image;
     }
 
     rgb24_image* gray_to_rgb_color(std::vector<gray8_image*> colors)
     {
         auto image = new rgb24_image(colors.at(0)->sx, colors.at(0)->sy);
-        int j = 0;
 
-        for (int i = 0; i < image->sx * image->sy * 3; i += 3)
-        {
-            image->pixels[i] = colors.at(0)->pixels[j];
-            image->pixels[i + 1] = colors.at(1)->pixels[j];
-            image->pixels[i + 2] = colors.at(2)->pixels[j];
-            j++;
-        }
+        parallel_rows(image->sy, [&](int begin, int end) {
+            for (int j = begin * image->sx; j < end * image->sx; j++)
+            {
+                int i = j * 3;
+                image->pixels[i] = colors.at(0)->pixels[j];
+                image->pixels[i + 1] = colors.at(1)->pixels[j];
+                image->pixels[i + 2] = colors.at(2)->pixels[j];
+            }
+        });
 
         return image;
     }
@@ -37,14 +44,15 @@ namespace tifo
     gray8_image* rgb_to_gray_no_color(rgb24_image& image)
     {
         auto gray_image = new gray8_image(image.sx, image.sy);
-        int j = 0;
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
-        {
-            gray_image->pixels[j] =
-                (image.pixels[i] + image.pixels[i + 1] + image.pixels[i + 2])
-                / 3;
-            j++;
-        }
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int j = begin * image.sx; j < end * image.sx; j++)
+            {
+                int i = j * 3;
+                gray_image->pixels[j] = (image.pixels[i] + image.pixels[i + 1]
+                                         + image.pixels[i + 2])
+                    / 3;
+            }
+        });
         return gray_image;
     }
 
@@ -54,15 +62,16 @@ namespace tifo
         auto red = new gray8_image(image.sx, image.sy);
         auto green = new gray8_image(image.sx, image.sy);
         auto blue = new gray8_image(image.sx, image.sy);
-        int j = 0;
 
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
-        {
-            red->pixels[j] = image.pixels[i];
-            green->pixels[j] = image.pixels[i + 1];
-            blue->pixels[j] = image.pixels[i + 2];
-            j++;
-        }
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int j = begin * image.sx; j < end * image.sx; j++)
+            {
+                int i = j * 3;
+                red->pixels[j] = image.pixels[i];
+                green->pixels[j] = image.pixels[i + 1];
+                blue->pixels[j] = image.pixels[i + 2];
+            }
+        });
 
         colors.push_back(red);
         colors.push_back(green);
@@ -77,15 +86,16 @@ namespace tifo
         auto hue = new gray8_image(image.sx, image.sy);
         auto sat = new gray8_image(image.sx, image.sy);
         auto val = new gray8_image(image.sx, image.sy);
-        int j = 0;
 
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
-        {
-            hue->pixels[j] = image.pixels[i];
-            sat->pixels[j] = image.pixels[i + 1];
-            val->pixels[j] = image.pixels[i + 2];
-            j++;
-        }
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int j = begin * image.sx; j < end * image.sx; j++)
+            {
+                int i = j * 3;
+                hue->pixels[j] = image.pixels[i];
+                sat->pixels[j] = image.pixels[i + 1];
+                val->pixels[j] = image.pixels[i + 2];
+            }
+        });
 
         canaux.push_back(hue);
         canaux.push_back(sat);
@@ -97,24 +107,25 @@ namespace tifo
     hsv24_image* gray_to_hsv_color(std::vector<gray8_image*> colors)
     {
         auto image = new hsv24_image(colors.at(0)->sx, colors.at(0)->sy);
-        int j = 0;
 
-        for (int i = 0; i < image->sx * image->sy * 3; i += 3)
-        {
-            image->pixels[i] = colors.at(0)->pixels[j];
-            image->pixels[i + 1] = colors.at(1)->pixels[j];
-            image->pixels[i + 2] = colors.at(2)->pixels[j];
-            j++;
-        }
+        parallel_rows(image->sy, [&](int begin, int end) {
+            for (int j = begin * image->sx; j < end * image->sx; j++)
+            {
+                int i = j * 3;
+                image->pixels[i] = colors.at(0)->pixels[j];
+                image->pixels[i + 1] = colors.at(1)->pixels[j];
+                image->pixels[i + 2] = colors.at(2)->pixels[j];
+            }
+        });
 
         return image;
     }
 
-    void rgb_color_hsv(std::vector<int>& rgb)
+    void rgb_color_hsv(int* rgb)
     {
-        double r = static_cast<double>(rgb.at(0)) / 255;
-        double g = static_cast<double>(rgb.at(1)) / 255;
-        double b = static_cast<double>(rgb.at(2)) / 255;
+        double r = static_cast<double>(rgb[0]) / 255;
+        double g = static_cast<double>(rgb[1]) / 255;
+        double b = static_cast<double>(rgb[2]) / 255;
 
         double cmin = std::min(std::min(r, g), b);
         double cmax = std::max(std::max(r, g), b);
@@ -145,11 +156,11 @@ namespace tifo
         rgb[2] = static_cast<int>(round(v));
     }
 
-    void hsv_color_rgb(std::vector<int>& hsv)
+    void hsv_color_rgb(int* hsv)
     {
-        int h = hsv.at(0);
-        int s = hsv.at(1);
-        int v = hsv.at(2);
+        int h = hsv[0];
+        int s = hsv[1];
+        int v = hsv[2];
 
         double _v = static_cast<double>(v) / 100;
         double _s = static_cast<double>(s) / 100;
@@ -205,49 +216,50 @@ namespace tifo
         hsv[2] = static_cast<int>(round(b));
     }
 
-    void rgb_to_hsv(rgb24_image& image)
+    void rgb_to_hsv_pixels(uint8_t* pixels, int count)
     {
-        std::vector<int> colors(3);
+        int colors[3];
 
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
+        for (int i = 0; i < count * 3; i += 3)
         {
-            colors[0] = image.pixels[i];
-            colors[1] = image.pixels[i + 1];
-            colors[2] = image.pixels[i + 2];
+            colors[0] = pixels[i];
+            colors[1] = pixels[i + 1];
+            colors[2] = pixels[i + 2];
 
             rgb_color_hsv(colors);
 
-            image.pixels[i] = colors[0];
-            image.pixels[i + 1] = colors[1];
-            image.pixels[i + 2] = colors[2];
+            pixels[i] = colors[0];
+            pixels[i + 1] = colors[1];
+            pixels[i + 2] = colors[2];
         }
     }
 
-    void hsv_to_rgb(hsv24_image& image)
+    void hsv_to_rgb_pixels(uint8_t* pixels, int count)
     {
-        std::vector<int> colors(3);
+        int colors[3];
 
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
+        for (int i = 0; i < count * 3; i += 3)
         {
-            colors[0] = image.pixels[i];
-            colors[1] = image.pixels[i + 1];
-            colors[2] = image.pixels[i + 2];
+            colors[0] = pixels[i];
+            colors[1] = pixels[i + 1];
+            colors[2] = pixels[i + 2];
 
             hsv_color_rgb(colors);
 
-            image.pixels[i] = colors[0];
-            image.pixels[i + 1] = colors[1];
-            image.pixels[i + 2] = colors[2];
+            pixels[i] = colors[0];
+            pixels[i + 1] = colors[1];
+            pixels[i + 2] = colors[2];
         }
     }
 
-    void rgb_to_YCrCb(rgb24_image& image)
+    void rgb_to_YCrCb_pixels(uint8_t* pixels, int count)
     {
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
+        for (int i = 0; i < count * 3; i += 3)
         {
-            float R = (float)image.pixels[i] / 255.0f; // Normalize to 0-1
-            float G = (float)image.pixels[i + 1] / 255.0f; // Normalize to 0-1
-            float B = (float)image.pixels[i + 2] / 255.0f; // Normalize to 0-1
+            // Normalize to 0-1
+            float R = (float)pixels[i] / 255.0f;
+            float G = (float)pixels[i + 1] / 255.0f;
+            float B = (float)pixels[i + 2] / 255.0f;
 
             float Y = 0.299f * R + 0.587f * G + 0.114f * B;
             float Cr = 0.5f * R - 0.4187f * G + 0.0813f * B + 0.5f;
@@ -257,19 +269,20 @@ namespace tifo
             Cr = std::max(0.0f, std::min(1.0f, G));
             Cb = std::max(0.0f, std::min(1.0f, B));
 
-            image.pixels[i] = (uint8_t)std::round(Y * 255.0f);
-            image.pixels[i + 1] = (uint8_t)std::round(Cr * 255.0f);
-            image.pixels[i + 2] = (uint8_t)std::round(Cb * 255.0f);
+            pixels[i] = (uint8_t)std::round(Y * 255.0f);
+            pixels[i + 1] = (uint8_t)std::round(Cr * 255.0f);
+            pixels[i + 2] = (uint8_t)std::round(Cb * 255.0f);
         }
     }
 
-    void yCrCb_to_rgb(rgb24_image& image)
+    void yCrCb_to_rgb_pixels(uint8_t* pixels, int count)
     {
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
+        for (int i = 0; i < count * 3; i += 3)
         {
-            float Y = (float)image.pixels[i] / 255.0f; // Normalize to 0-1
-            float Cr = (float)image.pixels[i + 1] / 255.0f; // Normalize to 0-1
-            float Cb = (float)image.pixels[i + 2] / 255.0f; // Normalize to 0-1
+            // Normalize to 0-1
+            float Y = (float)pixels[i] / 255.0f;
+            float Cr = (float)pixels[i + 1] / 255.0f;
+            float Cb = (float)pixels[i + 2] / 255.0f;
 
             float R = Y + 1.402f * (Cr - 0.5f);
             float G = Y - 0.34414f * (Cb - 0.5f) - 0.71414f * (Cr - 0.5f);
@@ -279,9 +292,117 @@ namespace tifo
             G = std::max(0.0f, std::min(1.0f, G));
             B = std::max(0.0f, std::min(1.0f, B));
 
-            image.pixels[i] = (uint8_t)std::round(R * 255.0f);
-            image.pixels[i + 1] = (uint8_t)std::round(G * 255.0f);
-            image.pixels[i + 2] = (uint8_t)std::round(B * 255.0f);
+            pixels[i] = (uint8_t)std::round(R * 255.0f);
+            pixels[i + 1] = (uint8_t)std::round(G * 255.0f);
+            pixels[i + 2] = (uint8_t)std::round(B * 255.0f);
         }
     }
+
+    void rgb_to_hsv(rgb24_image& image)
+    {
+        parallel_rows(image.sy, [&](int begin, int end) {
+            rgb_to_hsv_pixels(image.pixels + begin * image.sx * 3,
+                              (end - begin) * image.sx);
+        });
+    }
+
+    void hsv_to_rgb(hsv24_image& image)
+    {
+        parallel_rows(image.sy, [&](int begin, int end) {
+            hsv_to_rgb_pixels(image.pixels + begin * image.sx * 3,
+                              (end - begin) * image.sx);
+        });
+    }
+
+    void rgb_to_YCrCb(rgb24_image& image)
+    {
+        parallel_rows(image.sy, [&](int begin, int end) {
+            rgb_to_YCrCb_pixels(image.pixels + begin * image.sx * 3,
+                                (end - begin) * image.sx);
+        });
+    }
+
+    void yCrCb_to_rgb(rgb24_image& image)
+    {
+        parallel_rows(image.sy, [&](int begin, int end) {
+            yCrCb_to_rgb_pixels(image.pixels + begin * image.sx * 3,
+                                (end - begin) * image.sx);
+        });
+    }
+
+    namespace
+    {
+        // Channel c of the converted pixel, for each value of the channel
+        // of RGB it depends on
+        std::array<uint8_t, IMAGE_NB_LEVELS>
+        channel_table(void (*convert)(uint8_t*, int), int c)
+        {
+            std::array<uint8_t, IMAGE_NB_LEVELS> table;
+            for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+            {
+                uint8_t pixel[3] = { (uint8_t)level, (uint8_t)level,
+                                     (uint8_t)level };
+                convert(pixel, 1);
+                table[level] = pixel[c];
+            }
+            return table;
+        }
+    } // namespace
+
+    gray8_image* rgb_to_Y(const rgb24_image& image)
+    {
+        // Y only depends on R
+        static const auto table = channel_table(rgb_to_YCrCb_pixels, 0);
+
+        auto y = new gray8_image(image.sx, image.sy);
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int j = begin * image.sx; j < end * image.sx; j++)
+                y->pixels[j] = table[image.pixels[j * 3]];
+        });
+        return y;
+    }
+
+    gray8_image* rgb_to_V(const rgb24_image& image)
+    {
+        // V only depends on max(R, G, B)
+        static const auto table = channel_table(rgb_to_hsv_pixels, 2);
+
+        auto v = new gray8_image(image.sx, image.sy);
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int j = begin * image.sx; j < end * image.sx; j++)
+            {
+                int i = j * 3;
+                v->pixels[j] = table[std::max(
+                    { image.pixels[i], image.pixels[i + 1],
+                      image.pixels[i + 2] })];
+            }
+        });
+        return v;
+    }
+
+    void inject_Y(rgb24_image& image, const gray8_image& y)
+    {
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int j = begin * image.sx; j < end * image.sx; j++)
+            {
+                uint8_t* pixel = image.pixels + j * 3;
+                rgb_to_YCrCb_pixels(pixel, 1);
+                pixel[0] = y.pixels[j];
+                yCrCb_to_rgb_pixels(pixel, 1);
+            }
+        });
+    }
+
+    void inject_V(hsv24_image& image, const gray8_image& v)
+    {
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int j = begin * image.sx; j < end * image.sx; j++)
+            {
+                uint8_t* pixel = image.pixels + j * 3;
+                rgb_to_hsv_pixels(pixel, 1);
+                pixel[2] = std::min(v.pixels[j], (uint8_t)100);
+                hsv_to_rgb_pixels(pixel, 1);
+            }
+        });
+    }
 } // namespace tifo
\ No newline at end of file
@@ -19,6 +19,27 @@ namespace tifo
 
     void rgb_to_YCrCb(rgb24_image& image);
     void yCrCb_to_rgb(rgb24_image& image);
+
+    // Same conversions on count consecutive pixels
+    void rgb_to_hsv_pixels(uint8_t* pixels, int count);
+    void hsv_to_rgb_pixels(uint8_t* pixels, int count);
+    void rgb_to_YCrCb_pixels(uint8_t* pixels, int count);
+    void yCrCb_to_rgb_pixels(uint8_t* pixels, int count);
+
+    /**
+     * Y and V channels alone, as rgb_to_YCrCb and rgb_to_hsv would give
+     * them, for the filters which only change that channel.
+     */
+    gray8_image* rgb_to_Y(const rgb24_image& image);
+    gray8_image* rgb_to_V(const rgb24_image& image);
+
+    /**
+     * Converts each pixel, replaces its Y or V by the one of the plane and
+     * converts it back, without storing the other channels. V is clamped
+     * to 100.
+     */
+    void inject_Y(rgb24_image& image, const gray8_image& y);
+    void inject_V(hsv24_image& image, const gray8_image& v);
 } // namespace tifo
 
 #endif //TIFO_PROJECT_IMAGE_CONVERT_HH
@@ -1,32 +1,51 @@
 #include "image_operations.hh"
 
 #include <algorithm>
+#include <array>
+#include <cmath>
 #include <random>
 
+#include "scheduler.hh"
+
 namespace tifo
 {
+    void hue_pixels(uint8_t* pixels, int count, int h)
+    {
+        for (int i = 0; i < count * 3; i += 3)
+            pixels[i] = std::clamp(pixels[i] + h, 0, 360);
+    }
+
+    void saturation_pixels(uint8_t* pixels, int count, int s)
+    {
+        for (int i = 0; i < count * 3; i += 3)
+            pixels[i + 1] = std::clamp(pixels[i + 1] + s, 0, 100);
+    }
+
     void hue(hsv24_image& image, int h)
     {
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
-        {
-            image.pixels[i] = std::clamp(image.pixels[i] + h, 0, 360);
-        }
+        parallel_rows(image.sy, [&](int begin, int end) {
+            hue_pixels(image.pixels + begin * image.sx * 3,
+                       (end - begin) * image.sx, h);
+        });
     }
 
     void saturation(hsv24_image& image, int s)
     {
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
-        {
-            image.pixels[i + 1] = std::clamp(image.pixels[i + 1] + s, 0, 100);
-        }
+        parallel_rows(image.sy, [&](int begin, int end) {
+            saturation_pixels(image.pixels + begin * image.sx * 3,
+                              (end - begin) * image.sx, s);
+        });
     }
 
     void value(hsv24_image& image, int v)
     {
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
-        {
-            image.pixels[i + 2] = std::clamp(image.pixels[i + 2] + v, 0, 360);
-        }
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin * image.sx * 3; i < end * image.sx * 3; i += 3)
+            {
+                image.pixels[i + 2] =
+                    std::clamp(image.pixels[i + 2] + v, 0, 360);
+            }
+        });
     }
 
     void rgb_hue(rgb24_image& image, int h)
@@ -55,6 +74,9 @@ namespace tifo
         std::default_random_engine generator;
         std::uniform_int_distribution<int> distribution(-intensity, intensity);
 
+        // The grain sequence is drawn serially to stay reproducible.
+        check_cancelled();
+
         RGB8 pixels = image.get_buffer();
         for (int i = 0; i < image.sx * image.sy * 3; i += 3)
         {
@@ -72,26 +94,28 @@ namespace tifo
 
         RGB8 pixels = image.get_buffer();
 
-        for (int y = 0; y < image.sy; ++y)
-        {
-            for (int x = 0; x < image.sx; ++x)
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int y = begin; y < end; ++y)
             {
-                int dx = x - centerX;
-                int dy = y - centerY;
-                float distance =
-                    sqrt(dx * dx + dy * dy) / std::min(centerX, centerY);
-
-                int vignette =
-                    static_cast<int>((float)intensity * distance * distance);
-                int index = (y * image.sx + x) * 3;
-                image.pixels[index] =
-                    std::clamp(pixels[index] - vignette, 0, 255);
-                image.pixels[index + 1] =
-                    std::clamp(pixels[index + 1] - vignette, 0, 255);
-                image.pixels[index + 2] =
-                    std::clamp(pixels[index + 2] - vignette, 0, 255);
+                for (int x = 0; x < image.sx; ++x)
+                {
+                    int dx = x - centerX;
+                    int dy = y - centerY;
+                    float distance =
+                        sqrt(dx * dx + dy * dy) / std::min(centerX, centerY);
+
+                    int vignette = static_cast<int>((float)intensity * distance
+                                                    * distance);
+                    int index = (y * image.sx + x) * 3;
+                    image.pixels[index] =
+                        std::clamp(pixels[index] - vignette, 0, 255);
+                    image.pixels[index + 1] =
+                        std::clamp(pixels[index + 1] - vignette, 0, 255);
+                    image.pixels[index + 2] =
+                        std::clamp(pixels[index + 2] - vignette, 0, 255);
+                }
             }
-        }
+        });
     }
 
     void increase_contrast(tifo::rgb24_image& image, int f)
@@ -100,52 +124,73 @@ namespace tifo
 
         RGB8 pixels = image.get_buffer();
 
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
-        {
-            for (int j = 0; j < 3; ++j)
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin * image.sx * 3; i < end * image.sx * 3; i += 3)
             {
-                int value = pixels[i + j] - 128;
-                value = static_cast<int>(factor * value);
-                image.pixels[i + j] = std::clamp(value + 128, 0, 255);
+                for (int j = 0; j < 3; ++j)
+                {
+                    int value = pixels[i + j] - 128;
+                    value = static_cast<int>(factor * value);
+                    image.pixels[i + j] = std::clamp(value + 128, 0, 255);
+                }
             }
-        }
+        });
     }
 
     void adjust_black_point(rgb24_image& image, int blackPoint)
     {
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
-        {
-            for (int j = 0; j < 3; j++)
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin * image.sx * 3; i < end * image.sx * 3; i += 3)
             {
-                double pixel = image.pixels[i + j];
-
-                if (pixel <= blackPoint)
-                {
-                    image.pixels[i + j] = 0;
-                }
-                else
+                for (int j = 0; j < 3; j++)
                 {
-                    image.pixels[i + j] = image.pixels[i + j] - blackPoint;
+                    double pixel = image.pixels[i + j];
+
+                    if (pixel <= blackPoint)
+                    {
+                        image.pixels[i + j] = 0;
+                    }
+                    else
+                    {
+                        image.pixels[i + j] = image.pixels[i + j] - blackPoint;
+                    }
                 }
             }
-        }
+        });
     }
 
-    void swap_channels(tifo::rgb24_image& image, int channel1, int channel2)
+    void swap_channels_pixels(uint8_t* pixels, int count, int channel1,
+                              int channel2)
     {
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
+        for (int i = 0; i < count * 3; i += 3)
         {
-            auto tmp = image.pixels[i + channel1];
-            image.pixels[i + channel1] = image.pixels[i + channel2];
-            image.pixels[i + channel2] = tmp;
+            auto tmp = pixels[i + channel1];
+            pixels[i + channel1] = pixels[i + channel2];
+            pixels[i + channel2] = tmp;
         }
     }
 
+    void increase_channel_pixels(uint8_t* pixels, int count, int x,
+                                 int channel)
+    {
+        for (int i = 0; i < count * 3; i += 3)
+            pixels[i + channel] = std::clamp(pixels[i + channel] + x, 0, 255);
+    }
+
+    void swap_channels(tifo::rgb24_image& image, int channel1, int channel2)
+    {
+        parallel_rows(image.sy, [&](int begin, int end) {
+            swap_channels_pixels(image.pixels + begin * image.sx * 3,
+                                 (end - begin) * image.sx, channel1, channel2);
+        });
+    }
+
     void increase_channel(rgb24_image& image, int x, int channel)
     {
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
-            image.pixels[i + channel] =
-                std::clamp(image.pixels[i + channel] + x, 0, 255);
+        parallel_rows(image.sy, [&](int begin, int end) {
+            increase_channel_pixels(image.pixels + begin * image.sx * 3,
+                                    (end - begin) * image.sx, x, channel);
+        });
     }
 
     void yCrCb_increase_channel(yCrCb24_image& image, int x, int channel)
@@ -196,59 +241,67 @@ namespace tifo
 
     void negative_filter(rgb24_image& image)
     {
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
-        {
-            image.pixels[i + RED] = 255 - image.pixels[i + RED];
-            image.pixels[i + GREEN] = 255 - image.pixels[i + GREEN];
-            image.pixels[i + BLUE] = 255 - image.pixels[i + BLUE];
-        }
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin * image.sx * 3; i < end * image.sx * 3; i += 3)
+            {
+                image.pixels[i + RED] = 255 - image.pixels[i + RED];
+                image.pixels[i + GREEN] = 255 - image.pixels[i + GREEN];
+                image.pixels[i + BLUE] = 255 - image.pixels[i + BLUE];
+            }
+        });
     }
 
     void grayscale(rgb24_image& image)
     {
-        for (int i = 0; i < image.sx * image.sy * 3; i += 3)
-        {
-            auto gray = (image.pixels[i + RED] + image.pixels[i + GREEN]
-                         + image.pixels[i + BLUE])
-                / 3;
-            image.pixels[i + RED] = gray;
-            image.pixels[i + GREEN] = gray;
-            image.pixels[i + BLUE] = gray;
-        }
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin * image.sx * 3; i < end * image.sx * 3; i += 3)
+            {
+                auto gray = (image.pixels[i + RED] + image.pixels[i + GREEN]
+                             + image.pixels[i + BLUE])
+                    / 3;
+                image.pixels[i + RED] = gray;
+                image.pixels[i + GREEN] = gray;
+                image.pixels[i + BLUE] = gray;
+            }
+        });
     }
 
     void horizontal_flip(rgb24_image& image)
     {
         int half_width = image.sx / 2;
-        for (int i = 0; i < image.sy; i++)
-        {
-            for (int j = 0; j < half_width; j++)
+        parallel_rows(image.sy, [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
             {
-                int left = (i * image.sx + j) * 3;
-                int right = (i * image.sx + image.sx - 1 - j) * 3;
+                for (int j = 0; j < half_width; j++)
+                {
+                    int left = (i * image.sx + j) * 3;
+                    int right = (i * image.sx + image.sx - 1 - j) * 3;
 
-                std::swap(image.pixels[left], image.pixels[right]);
-                std::swap(image.pixels[left + 1], image.pixels[right + 1]);
-                std::swap(image.pixels[left + 2], image.pixels[right + 2]);
+                    std::swap(image.pixels[left], image.pixels[right]);
+                    std::swap(image.pixels[left + 1], image.pixels[right + 1]);
+                    std::swap(image.pixels[left + 2], image.pixels[right + 2]);
+                }
             }
-        }
+        });
     }
 
     void vertical_flip(rgb24_image& image)
     {
         int half_height = image.sy / 2;
-        for (int i = 0; i < half_height; i++)
-        {
-            for (int j = 0; j < image.sx; j++)
+        parallel_rows(half_height, [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
             {
-                int top = (i * image.sx + j) * 3;
-                int bottom = ((image.sy - 1 - i) * image.sx + j) * 3;
+                for (int j = 0; j < image.sx; j++)
+                {
+                    int top = (i * image.sx + j) * 3;
+                    int bottom = ((image.sy - 1 - i) * image.sx + j) * 3;
 
-                std::swap(image.pixels[top], image.pixels[bottom]);
-                std::swap(image.pixels[top + 1], image.pixels[bottom + 1]);
-                std::swap(image.pixels[top + 2], image.pixels[bottom + 2]);
+                    std::swap(image.pixels[top], image.pixels[bottom]);
+                    std::swap(image.pixels[top + 1], image.pixels[bottom + 1]);
+                    std::swap(image.pixels[top + 2], image.pixels[bottom + 2]);
+                }
             }
-        }
+        });
     }
 
     std::array<uint8_t, 3> interpolate_pixel(const rgb24_image& image, float x,
@@ -309,43 +362,43 @@ namespace tifo
 
         auto rotated =
             new rgb24_image(new_width, new_height); // Create new image
-        rotated->sx = new_width;
-        rotated->sy = new_height;
-        rotated->pixels =
-            new uint8_t[new_width * new_height * 3]; // Allocate memory
 
         int original_mid_x = original.sx / 2;
         int original_mid_y = original.sy / 2;
         int rotated_mid_x = new_width / 2;
         int rotated_mid_y = new_height / 2;
 
-        for (int y = 0; y < new_height; ++y)
-        {
-            for (int x = 0; x < new_width; ++x)
+        parallel_rows(new_height, [&](int begin, int end) {
+            for (int y = begin; y < end; ++y)
             {
-                int dx = x - rotated_mid_x;
-                int dy = y - rotated_mid_y;
-
-                float old_x = original_mid_x + (dx * cos(rad) - dy * sin(rad));
-                float old_y = original_mid_y + (dx * sin(rad) + dy * cos(rad));
-
-                if (old_x >= 0 && old_x < original.sx - 1 && old_y >= 0
-                    && old_y < original.sy - 1)
-                {
-                    std::array<uint8_t, 3> color =
-                        interpolate_pixel(original, old_x, old_y);
-                    rotated->pixels[(y * new_width + x) * 3] = color[0];
-                    rotated->pixels[(y * new_width + x) * 3 + 1] = color[1];
-                    rotated->pixels[(y * new_width + x) * 3 + 2] = color[2];
-                }
-                else
+                for (int x = 0; x < new_width; ++x)
                 {
-                    rotated->pixels[(y * new_width + x) * 3] = 0;
-                    rotated->pixels[(y * new_width + x) * 3 + 1] = 0;
-                    rotated->pixels[(y * new_width + x) * 3 + 2] = 0;
+                    int dx = x - rotated_mid_x;
+                    int dy = y - rotated_mid_y;
+
+                    float old_x =
+                        original_mid_x + (dx * cos(rad) - dy * sin(rad));
+                    float old_y =
+                        original_mid_y + (dx * sin(rad) + dy * cos(rad));
+
+                    if (old_x >= 0 && old_x < original.sx - 1 && old_y >= 0
+                        && old_y < original.sy - 1)
+                    {
+                        std::array<uint8_t, 3> color =
+                            interpolate_pixel(original, old_x, old_y);
+                        rotated->pixels[(y * new_width + x) * 3] = color[0];
+                        rotated->pixels[(y * new_width + x) * 3 + 1] = color[1];
+                        rotated->pixels[(y * new_width + x) * 3 + 2] = color[2];
+                    }
+                    else
+                    {
+                        rotated->pixels[(y * new_width + x) * 3] = 0;
+                        rotated->pixels[(y * new_width + x) * 3 + 1] = 0;
+                        rotated->pixels[(y * new_width + x) * 3 + 2] = 0;
+                    }
                 }
             }
-        }
+        });
 
         return rotated;
     }
@@ -25,6 +25,14 @@ namespace tifo
     void increase_channel(rgb24_image& image, int x, int channel);
     void yCrCb_increase_channel(yCrCb24_image& image, int x, int channel);
 
+    // Same operations on count consecutive pixels
+    void hue_pixels(uint8_t* pixels, int count, int h);
+    void saturation_pixels(uint8_t* pixels, int count, int s);
+    void swap_channels_pixels(uint8_t* pixels, int count, int channel1,
+                              int channel2);
+    void increase_channel_pixels(uint8_t* pixels, int count, int x,
+                                 int channel);
+
     // FILTERS
     void argentique_filter(tifo::rgb24_image& image);
     void ir_filter(rgb24_image& image);
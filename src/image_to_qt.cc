@@ -2,38 +2,38 @@
 
 #include <QDebug>
 
-QImage rgb_to_qimage(const tifo::rgb24_image& inputImage)
+void rgb_to_qimage(const tifo::rgb24_image& inputImage, QImage& outputImage)
 {
     int width = inputImage.sx;
     int height = inputImage.sy;
 
-    int k = 0;
-
-    QImage outputImage(width, height, QImage::Format_RGB32);
+    if (outputImage.width() != width || outputImage.height() != height
+        || outputImage.format() != QImage::Format_RGB32)
+        outputImage = QImage(width, height, QImage::Format_RGB32);
 
     for (int y = 0; y < height; ++y)
     {
-        for (int x = 0; x < width; ++x)
-        {
-            int red = inputImage.pixels[k];
-            int green = inputImage.pixels[k + 1];
-            int blue = inputImage.pixels[k + 2];
+        auto line = reinterpret_cast<QRgb*>(outputImage.scanLine(y));
+        const uint8_t* src = inputImage.pixels + y * width * 3;
 
-            k += 3;
-
-            QColor color(red, green, blue);
-            outputImage.setPixelColor(x, y, color);
-        }
+        for (int x = 0; x < width; ++x)
+            line[x] = qRgb(src[x * 3], src[x * 3 + 1], src[x * 3 + 2]);
     }
+}
 
+QImage rgb_to_qimage(const tifo::rgb24_image& inputImage)
+{
+    QImage outputImage;
+    rgb_to_qimage(inputImage, outputImage);
     return outputImage;
 }
 
 tifo::rgb24_image* qimage_to_rgb(const QImage& inputImage)
 {
-    int width = inputImage.width();
-    int height = inputImage.height();
-    int k = 0;
+    QImage image = inputImage.convertToFormat(QImage::Format_RGB32);
+
+    int width = image.width();
+    int height = image.height();
 
     auto outputImage = new tifo::rgb24_image(width, height);
 
@@ -42,20 +42,16 @@ tifo::rgb24_image* qimage_to_rgb(const QImage& inputImage)
 
     for (int y = 0; y < height; ++y)
     {
+        auto line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+        uint8_t* dst = outputImage->pixels + y * width * 3;
+
         for (int x = 0; x < width; ++x)
         {
-            QColor color = inputImage.pixelColor(x, y);
-            int red = color.red();
-            int green = color.green();
-            int blue = color.blue();
-
-            outputImage->pixels[k] = red;
-            outputImage->pixels[k + 1] = green;
-            outputImage->pixels[k + 2] = blue;
-
-            k += 3;
+            dst[x * 3] = qRed(line[x]);
+            dst[x * 3 + 1] = qGreen(line[x]);
+            dst[x * 3 + 2] = qBlue(line[x]);
         }
     }
 
     return outputImage;
-}
\ No newline at end of file
+}
@@ -5,4 +5,10 @@
 #include "image.hh"
 
 tifo::rgb24_image* qimage_to_rgb(const QImage& inputImage);
-QImage rgb_to_qimage(const tifo::rgb24_image& inputImage);
\ No newline at end of file
+QImage rgb_to_qimage(const tifo::rgb24_image& inputImage);
+
+/**
+ * Converts into an existing QImage, only reallocating it when the size
+ * changed, so the display buffer can be reused across edits.
+ */
+void rgb_to_qimage(const tifo::rgb24_image& inputImage, QImage& outputImage);
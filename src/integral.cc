@@ -0,0 +1,154 @@
+#include "integral.hh"
+
+#include "scheduler.hh"
+
+namespace tifo
+{
+    namespace
+    {
+        // Table of the values of the interleaved pixels inside rect, or of
+        // their squares
+        template <typename Sum, int channels, bool squared>
+        integral_image<Sum> build(const uint8_t* pixels, int sx, int sy,
+                                  const image_rect& rect)
+        {
+            integral_image<Sum> table(rect.intersected({ 0, 0, sx, sy }),
+                                      channels);
+            auto& area = table.area;
+            int width = table.width();
+            int height = table.height();
+            if (width == 0 || height == 0)
+                return table;
+
+            std::size_t row_size = (std::size_t)(width + 1) * channels;
+            Sum* sums = table.sums.data();
+
+            // Sums along each row, the first row and column staying null
+            parallel_rows(height, [&](int begin, int end) {
+                for (int y = begin; y < end; y++)
+                {
+                    const uint8_t* in =
+                        pixels + ((std::size_t)(area.y0 + y) * sx + area.x0)
+                            * channels;
+                    Sum* out = sums + (y + 1) * row_size + channels;
+
+                    Sum running[channels] = {};
+                    for (int x = 0; x < width; x++)
+                    {
+                        for (int c = 0; c < channels; c++)
+                        {
+                            Sum value = in[x * channels + c];
+                            running[c] += squared ? value * value : value;
+                            out[x * channels + c] = running[c];
+                        }
+                    }
+                }
+            });
+
+            // Each band of columns carries the rows above down the table,
+            // in straight adds of whole row slices
+            parallel_rows(row_size, [&](int begin, int end) {
+                for (int y = 2; y <= height; y++)
+                {
+                    Sum* row = sums + y * row_size;
+                    const Sum* above = row - row_size;
+                    for (int i = begin; i < end; i++)
+                        row[i] += above[i];
+                }
+            });
+
+            return table;
+        }
+    } // namespace
+
+    template <typename Sum>
+    integral_image<Sum> make_integral(const gray8_image& image)
+    {
+        return make_integral<Sum>(image, { 0, 0, image.sx, image.sy });
+    }
+
+    template <typename Sum>
+    integral_image<Sum> make_integral(const gray8_image& image,
+                                      const image_rect& rect)
+    {
+        return build<Sum, 1, false>(image.pixels, image.sx, image.sy, rect);
+    }
+
+    template <typename Sum>
+    integral_image<Sum> make_integral(const rgb24_image& image)
+    {
+        return make_integral<Sum>(image, { 0, 0, image.sx, image.sy });
+    }
+
+    template <typename Sum>
+    integral_image<Sum> make_integral(const rgb24_image& image,
+                                      const image_rect& rect)
+    {
+        return build<Sum, 3, false>(image.pixels, image.sx, image.sy, rect);
+    }
+
+    template <typename Sum>
+    integral_image<Sum> make_squared_integral(const gray8_image& image,
+                                              const image_rect& rect)
+    {
+        return build<Sum, 1, true>(image.pixels, image.sx, image.sy, rect);
+    }
+
+    template <typename Sum>
+    integral_image<Sum> make_squared_integral(const rgb24_image& image,
+                                              const image_rect& rect)
+    {
+        return build<Sum, 3, true>(image.pixels, image.sx, image.sy, rect);
+    }
+
+    template <typename Sum>
+    integral_moments<Sum> make_moments(const gray8_image& image,
+                                       const image_rect& rect)
+    {
+        return { make_integral<Sum>(image, rect),
+                 make_squared_integral<Sum>(image, rect) };
+    }
+
+    template <typename Sum>
+    integral_moments<Sum> make_moments(const rgb24_image& image,
+                                       const image_rect& rect)
+    {
+        return { make_integral<Sum>(image, rect),
+                 make_squared_integral<Sum>(image, rect) };
+    }
+
+    // The two widths of sums the header offers
+    template integral_image<uint32_t>
+    make_integral(const gray8_image&);
+    template integral_image<uint32_t>
+    make_integral(const gray8_image&, const image_rect&);
+    template integral_image<uint32_t>
+    make_integral(const rgb24_image&);
+    template integral_image<uint32_t>
+    make_integral(const rgb24_image&, const image_rect&);
+    template integral_image<uint32_t>
+    make_squared_integral(const gray8_image&, const image_rect&);
+    template integral_image<uint32_t>
+    make_squared_integral(const rgb24_image&, const image_rect&);
+    template integral_moments<uint32_t>
+    make_moments(const gray8_image&, const image_rect&);
+    template integral_moments<uint32_t>
+    make_moments(const rgb24_image&, const image_rect&);
+
+    template integral_image<uint64_t>
+    make_integral(const gray8_image&);
+    template integral_image<uint64_t>
+    make_integral(const gray8_image&, const image_rect&);
+    template integral_image<uint64_t>
+    make_integral(const rgb24_image&);
+    template integral_image<uint64_t>
+    make_integral(const rgb24_image&, const image_rect&);
+    template integral_image<uint64_t>
+    make_squared_integral(const gray8_image&, const image_rect&);
+    template integral_image<uint64_t>
+    make_squared_integral(const rgb24_image&, const image_rect&);
+    template integral_moments<uint64_t>
+    make_moments(const gray8_image&, const image_rect&);
+    template integral_moments<uint64_t>
+    make_moments(const rgb24_image&, const image_rect&);
+} // namespace tifo
@@ -0,0 +1,149 @@
+#ifndef TIFO_PROJECT_INTEGRAL_HH
+#define TIFO_PROJECT_INTEGRAL_HH
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "image.hh"
+#include "region.hh"
+
+namespace tifo
+{
+    /**
+     * Summed area table of a rectangle of an image: the sum of the values
+     * of each channel above and left of each pixel corner, so that the sum
+     * over any rectangle inside it takes four reads.
+     *
+     * Sums wrap around modulo 2^bits, which leaves rect_sum exact as long
+     * as the sum over the rectangle itself fits in Sum: with 32 bits, up to
+     * 2^32 / 255 pixels for values and 2^32 / 255^2 (256 x 256) for squares.
+     * Tables of a whole huge image take 4 or 8 bytes per value: build them
+     * over tiles with their margin instead.
+     */
+    template <typename Sum>
+    class integral_image
+    {
+    public:
+        integral_image() = default;
+
+        integral_image(const image_rect& area, int channels)
+            : area(area)
+            , channels(channels)
+            , sums((std::size_t)(width() + 1) * (height() + 1) * channels, 0)
+        {}
+
+        int width() const
+        {
+            return std::max(area.x1 - area.x0, 0);
+        }
+
+        int height() const
+        {
+            return std::max(area.y1 - area.y0, 0);
+        }
+
+        /**
+         * Sum of the values of the pixels above and left of corner (x, y),
+         * in coordinates of the image, inside area.
+         */
+        Sum corner(int x, int y, int channel = 0) const
+        {
+            return sums[((std::size_t)(y - area.y0) * (width() + 1)
+                         + (x - area.x0))
+                            * channels
+                        + channel];
+        }
+
+        /** Sum over a rectangle, which must lie inside area. */
+        Sum rect_sum(const image_rect& rect, int channel = 0) const
+        {
+            return corner(rect.x1, rect.y1, channel)
+                - corner(rect.x0, rect.y1, channel)
+                - corner(rect.x1, rect.y0, channel)
+                + corner(rect.x0, rect.y0, channel);
+        }
+
+        /** 0 for an empty rectangle. */
+        double rect_mean(const image_rect& rect, int channel = 0) const
+        {
+            if (rect.empty())
+                return 0;
+            return (double)rect_sum(rect, channel) / rect.area();
+        }
+
+        /** Pixels the table covers. */
+        image_rect area;
+        /** Interleaved like the pixels: 1 for gray images, 3 for RGB. */
+        int channels = 1;
+        /** (width + 1) x (height + 1) corners, the first row and column 0. */
+        std::vector<Sum> sums;
+    };
+
+    /** Tables of the values and of their squares, for local statistics. */
+    template <typename Sum>
+    struct integral_moments
+    {
+        integral_image<Sum> sums;
+        integral_image<Sum> squares;
+
+        double rect_mean(const image_rect& rect, int channel = 0) const
+        {
+            return sums.rect_mean(rect, channel);
+        }
+
+        /** Population variance, 0 for an empty rectangle. */
+        double rect_var(const image_rect& rect, int channel = 0) const
+        {
+            if (rect.empty())
+                return 0;
+
+            double mean = rect_mean(rect, channel);
+            double var = (double)squares.rect_sum(rect, channel) / rect.area()
+                - mean * mean;
+            return std::max(var, 0.0);
+        }
+
+        double rect_stddev(const image_rect& rect, int channel = 0) const
+        {
+            return std::sqrt(rect_var(rect, channel));
+        }
+    };
+
+    typedef integral_image<uint32_t> integral32;
+    typedef integral_image<uint64_t> integral64;
+
+    /*
+     * Each row is summed on its own, in parallel bands, then bands of
+     * columns add the rows above down the table. The rectangle is clipped
+     * to the image.
+     */
+    template <typename Sum>
+    integral_image<Sum> make_integral(const gray8_image& image);
+    template <typename Sum>
+    integral_image<Sum> make_integral(const gray8_image& image,
+                                      const image_rect& rect);
+    template <typename Sum>
+    integral_image<Sum> make_integral(const rgb24_image& image);
+    template <typename Sum>
+    integral_image<Sum> make_integral(const rgb24_image& image,
+                                      const image_rect& rect);
+
+    /** Same as make_integral, over the squares of the values. */
+    template <typename Sum>
+    integral_image<Sum> make_squared_integral(const gray8_image& image,
+                                              const image_rect& rect);
+    template <typename Sum>
+    integral_image<Sum> make_squared_integral(const rgb24_image& image,
+                                              const image_rect& rect);
+
+    template <typename Sum>
+    integral_moments<Sum> make_moments(const gray8_image& image,
+                                       const image_rect& rect);
+    template <typename Sum>
+    integral_moments<Sum> make_moments(const rgb24_image& image,
+                                       const image_rect& rect);
+} // namespace tifo
+
+#endif //TIFO_PROJECT_INTEGRAL_HH
@@ -0,0 +1,162 @@
+#include "layers.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "scheduler.hh"
+
+namespace tifo
+{
+    namespace
+    {
+        // x / 255 rounded, exact for 0 <= x <= 255 * 255
+        inline int div255(int x)
+        {
+            x += 128;
+            return (x + (x >> 8)) >> 8;
+        }
+
+        template <blend_mode mode>
+        inline int blend(int a, int b)
+        {
+            if constexpr (mode == blend_mode::normal)
+                return b;
+            else if constexpr (mode == blend_mode::add)
+                return std::min(a + b, 255);
+            else if constexpr (mode == blend_mode::screen)
+                return 255 - div255((255 - a) * (255 - b));
+            else if constexpr (mode == blend_mode::multiply)
+                return div255(a * b);
+            else if constexpr (mode == blend_mode::overlay)
+                return a < 128 ? 2 * div255(a * b)
+                               : 255 - 2 * div255((255 - a) * (255 - b));
+            else
+            {
+                // Pegtop soft light: a^2 + 2b(a - a^2)
+                int square = div255(a * a);
+                return std::min(square + 2 * div255(b * (a - square)), 255);
+            }
+        }
+
+        // Blends n bytes of a layer over a row. Written without branches
+        // on the data so that the compiler vectorizes it.
+        template <blend_mode mode, typename Weight>
+        void blend_row(uint8_t* __restrict__ row,
+                       const uint8_t* __restrict__ layer, int n,
+                       Weight weight)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                int a = row[i];
+                int w = weight(i);
+                row[i] = div255(a * (255 - w) + blend<mode>(a, layer[i]) * w);
+            }
+        }
+
+        template <blend_mode mode>
+        void blend_row(uint8_t* row, const uint8_t* layer, int n, int opacity,
+                       const uint8_t* weights)
+        {
+            if (weights)
+                blend_row<mode>(row, layer, n,
+                                [=](int i) { return weights[i]; });
+            else if (opacity == 255)
+                blend_row<mode>(row, layer, n, [](int) { return 255; });
+            else
+                blend_row<mode>(row, layer, n,
+                                [=](int) { return opacity; });
+        }
+
+        // weights, if not null, gives the weight of each byte
+        void blend_row(blend_mode mode, uint8_t* row, const uint8_t* layer,
+                       int n, int opacity, const uint8_t* weights)
+        {
+            switch (mode)
+            {
+            case blend_mode::normal:
+                blend_row<blend_mode::normal>(row, layer, n, opacity, weights);
+                break;
+            case blend_mode::add:
+                blend_row<blend_mode::add>(row, layer, n, opacity, weights);
+                break;
+            case blend_mode::screen:
+                blend_row<blend_mode::screen>(row, layer, n, opacity, weights);
+                break;
+            case blend_mode::multiply:
+                blend_row<blend_mode::multiply>(row, layer, n, opacity,
+                                                weights);
+                break;
+            case blend_mode::overlay:
+                blend_row<blend_mode::overlay>(row, layer, n, opacity,
+                                               weights);
+                break;
+            case blend_mode::soft_light:
+                blend_row<blend_mode::soft_light>(row, layer, n, opacity,
+                                                  weights);
+                break;
+            }
+        }
+    } // namespace
+
+    void flatten_layers(rgb24_image& image, const std::vector<layer>& layers)
+    {
+        for (auto& layer : layers)
+        {
+            if (!layer.image || layer.image->sx != image.sx
+                || layer.image->sy != image.sy)
+                throw std::invalid_argument(
+                    "A layer must have the size of the image");
+        }
+
+        parallel_rows(image.sy, [&](int begin, int end) {
+            std::vector<uint8_t> weights(image.sx * 3);
+
+            for (int y = begin; y < end; y++)
+            {
+                uint8_t* row = image.pixels + y * image.sx * 3;
+
+                for (auto& layer : layers)
+                {
+                    int opacity = std::lround(
+                        std::clamp(layer.opacity, 0.0f, 1.0f) * 255);
+                    if (opacity == 0)
+                        continue;
+
+                    const uint8_t* source =
+                        layer.image->pixels + y * image.sx * 3;
+                    if (!layer.mask)
+                    {
+                        blend_row(layer.mode, row, source, image.sx * 3,
+                                  opacity, nullptr);
+                        continue;
+                    }
+
+                    // Only the part of the row inside the mask
+                    auto& mask = *layer.mask;
+                    auto span = mask.bounds.intersected(
+                        { 0, y, image.sx, y + 1 });
+                    if (span.empty())
+                        continue;
+
+                    const uint8_t* coverage = mask.coverage.data()
+                        + (long)(y - mask.bounds.y0)
+                            * (mask.bounds.x1 - mask.bounds.x0);
+                    int n = (span.x1 - span.x0) * 3;
+                    for (int x = span.x0; x < span.x1; x++)
+                    {
+                        uint8_t w =
+                            div255(coverage[x - mask.bounds.x0] * opacity);
+                        weights[(x - span.x0) * 3] = w;
+                        weights[(x - span.x0) * 3 + 1] = w;
+                        weights[(x - span.x0) * 3 + 2] = w;
+                    }
+
+                    blend_row(layer.mode, row + span.x0 * 3,
+                              source + span.x0 * 3, n, opacity,
+                              weights.data());
+                }
+            }
+        });
+    }
+} // namespace tifo
@@ -0,0 +1,45 @@
+#ifndef TIFO_PROJECT_LAYERS_HH
+#define TIFO_PROJECT_LAYERS_HH
+
+#include <memory>
+#include <vector>
+
+#include "image.hh"
+#include "selection.hh"
+
+namespace tifo
+{
+    enum class blend_mode
+    {
+        normal,
+        add,
+        screen,
+        multiply,
+        overlay,
+        soft_light,
+    };
+
+    /**
+     * Image composited over the ones below it, of the same size as the
+     * base image.
+     */
+    struct layer
+    {
+        std::shared_ptr<const rgb24_image> image;
+        blend_mode mode = blend_mode::normal;
+        /** From 0 (hidden) to 1. */
+        float opacity = 1;
+        /** Coverage scaling the opacity of each pixel, null for none. */
+        std::shared_ptr<const selection> mask;
+    };
+
+    /**
+     * Composites the layers over the image, bottom first. All of them are
+     * blended into each row while it is in cache, so the image is only
+     * read and written once whatever the number of layers. Pixels outside
+     * the mask of a layer are skipped for that layer.
+     */
+    void flatten_layers(rgb24_image& image, const std::vector<layer>& layers);
+} // namespace tifo
+
+#endif //TIFO_PROJECT_LAYERS_HH
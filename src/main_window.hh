@@ -2,6 +2,7 @@
 
 #include <QApplication>
 #include <QCheckBox>
+#include <QComboBox>
 #include <QDebug>
 #include <QElapsedTimer>
 #include <QFileDialog>
@@ -9,17 +10,49 @@
 #include <QImage>
 #include <QLabel>
 #include <QLineEdit>
+#include <QListWidget>
 #include <QMessageBox>
 #include <QMouseEvent>
+#include <QPaintEvent>
+#include <QPainter>
+#include <QProgressBar>
+#include <QPolygonF>
 #include <QPushButton>
+#include <QRadioButton>
 #include <QScrollArea>
+#include <QScrollBar>
 #include <QSlider>
+#include <QStatusBar>
+#include <QTimer>
 #include <QVBoxLayout>
-
+#include <QWheelEvent>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+
+#include "brush.hh"
+#include "canny.hh"
+#include "clahe.hh"
+#include "edit_stack.hh"
+#include "editor_worker.hh"
+#include "filter_graph.hh"
 #include "image.hh"
 #include "image_convert.hh"
 #include "image_operations.hh"
 #include "image_to_qt.hh"
+#include "median.hh"
+#include "preview_cache.hh"
+#include "pyramid.hh"
+#include "region.hh"
+#include "scope.hh"
+#include "selection.hh"
 
 class SquareButton : public QPushButton
 {
@@ -65,39 +98,659 @@ protected:
     }
 };
 
-class ResizableImageLabel : public QLabel
+/**
+ * Zoomable view of an image in a ResizableScrollArea. The image is fitted
+ * in the window until zoomed with the wheel; double click toggles between
+ * fit and 100%, dragging pans.
+ *
+ * Only the visible tiles of the pyramid level matching the zoom are drawn.
+ * They are cut on a worker and cached; until one is ready, the same tile
+ * of the previous image or a coarser cached one stands in.
+ *
+ * With a selection tool, dragging draws a rectangle or a freehand outline
+ * instead, reported in pixels of the image. With the brush, the dragged
+ * path is reported point by point.
+ */
+class ImageViewer : public QWidget
 {
     Q_OBJECT
 
 public:
-    explicit ResizableImageLabel(QWidget* parent = nullptr,
-                                 Qt::WindowFlags f = Qt::WindowFlags())
-        : QLabel(parent, f)
+    enum class Tool
+    {
+        Pan,
+        RectangleSelection,
+        FreehandSelection,
+        Brush,
+    };
+
+    explicit ImageViewer(ResizableScrollArea* area)
+        : QWidget(area)
+        , area(area)
+    {
+        connect(area, &ResizableScrollArea::resized, this,
+                &ImageViewer::updateLayout);
+
+        builder = new EditorWorker(this);
+        connect(builder, &EditorWorker::finished, this,
+                &ImageViewer::tilesBuilt);
+        builder->start();
+    }
+
+    /** Shows the image of a pyramid, dropping the overlay. */
+    void setPyramid(std::shared_ptr<tifo::image_pyramid> pyramid)
+    {
+        overlay = QImage();
+
+        if (pyramid != this->pyramid)
+        {
+            builder->cancelAll();
+            buildJob = 0;
+
+            bool sameSize = this->pyramid
+                && this->pyramid->base().sx == pyramid->base().sx
+                && this->pyramid->base().sy == pyramid->base().sy;
+
+            staleTiles.clear();
+            if (sameSize)
+                staleTiles.swap(tiles);
+            tiles.clear();
+
+            this->pyramid = std::move(pyramid);
+            if (!sameSize)
+                fit = true;
+        }
+
+        updateLayout();
+    }
+
+    void setImage(ConstImagePtr image)
+    {
+        setPyramid(std::make_shared<tifo::image_pyramid>(std::move(image)));
+    }
+
+    /**
+     * Draws image over the given rectangle of a pyramid level, until the
+     * pyramid changes.
+     */
+    void setOverlay(const tifo::rgb24_image& image, tifo::image_rect rect,
+                    int level)
+    {
+        overlay = rgb_to_qimage(image);
+        overlayRect = rect;
+        overlayLevel = level;
+        update();
+    }
+
+    bool isZoomed() const
+    {
+        return !fit;
+    }
+
+    Tool tool() const
+    {
+        return currentTool;
+    }
+
+    void setTool(Tool tool)
     {
-        if (parent)
-            connect(parent, SIGNAL(resized()), this, SLOT(updatePixmap()));
+        currentTool = tool;
+        if (tool == Tool::Pan)
+            unsetCursor();
+        else
+            setCursor(Qt::CrossCursor);
     }
 
+    /** Hides the selection outline, without notifying it. */
+    void clearSelection()
+    {
+        outline.clear();
+        update();
+    }
+
+    /** Pyramid level the tiles are cut from at the current zoom. */
+    int displayLevel() const
+    {
+        if (!pyramid)
+            return 0;
+
+        auto& image = pyramid->base();
+        return pyramid->level_index_for(std::ceil(image.sx * zoom),
+                                        std::ceil(image.sy * zoom));
+    }
+
+    /** Part of the image shown in the viewport, in pixels of level 0. */
+    tifo::image_rect visibleRect() const
+    {
+        if (!pyramid)
+            return {};
+
+        auto& image = pyramid->base();
+        auto viewport = area->viewport()->size();
+        QPointF topLeft = (QPointF(area->horizontalScrollBar()->value(),
+                                   area->verticalScrollBar()->value())
+                           - origin())
+            / zoom;
+
+        tifo::image_rect rect{
+            (int)std::floor(topLeft.x()), (int)std::floor(topLeft.y()),
+            (int)std::ceil(topLeft.x() + viewport.width() / zoom),
+            (int)std::ceil(topLeft.y() + viewport.height() / zoom)
+        };
+        return rect.intersected({ 0, 0, image.sx, image.sy });
+    }
+
+signals:
+    /**
+     * Emitted once a selection is drawn, with its outline in pixels of
+     * level 0. A rectangle is given by its 4 corners.
+     */
+    void selectionChanged(const QPolygonF& outline);
+
+    /** Brush path, in pixels of level 0, until the button is released. */
+    void strokeMoved(QPointF point);
+    void strokeFinished();
+
 public slots:
-    void updatePixmap()
+    void updateLayout()
+    {
+        if (!pyramid)
+            return;
+
+        auto& image = pyramid->base();
+        auto viewport = area->viewport()->size();
+        if (fit)
+            zoom = fitZoom();
+
+        resize(std::max<int>(viewport.width(), std::ceil(image.sx * zoom)),
+               std::max<int>(viewport.height(), std::ceil(image.sy * zoom)));
+        update();
+    }
+
+protected:
+    void paintEvent(QPaintEvent* event) override
+    {
+        if (!pyramid)
+            return;
+
+        QPainter painter(this);
+
+        int level = displayLevel();
+        int sx = pyramid->base().sx;
+        int sy = pyramid->base().sy;
+        for (int n = 0; n < level; n++)
+        {
+            sx = (sx + 1) / 2;
+            sy = (sy + 1) / 2;
+        }
+
+        // Display pixels per pixel of the level: magnified pixels stay sharp
+        double scale = zoom * (1 << level);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform, scale < 1);
+
+        auto o = origin();
+        auto dirty = event->rect();
+        int tx0 = std::max(0.0, (dirty.left() - o.x()) / scale / tileSize);
+        int ty0 = std::max(0.0, (dirty.top() - o.y()) / scale / tileSize);
+        int tx1 = std::min<int>((sx - 1) / tileSize,
+                                (dirty.right() - o.x()) / scale / tileSize);
+        int ty1 = std::min<int>((sy - 1) / tileSize,
+                                (dirty.bottom() - o.y()) / scale / tileSize);
+
+        std::vector<TileKey> missing;
+        for (int ty = ty0; ty <= ty1; ty++)
+        {
+            for (int tx = tx0; tx <= tx1; tx++)
+            {
+                int w = std::min(tileSize, sx - tx * tileSize);
+                int h = std::min(tileSize, sy - ty * tileSize);
+                QRectF target(o.x() + tx * tileSize * scale,
+                              o.y() + ty * tileSize * scale, w * scale,
+                              h * scale);
+
+                TileKey key{ level, tx, ty };
+                if (auto tile = findTile(tiles, key))
+                {
+                    painter.drawPixmap(target, *tile, QRectF(0, 0, w, h));
+                    continue;
+                }
+
+                missing.push_back(key);
+                drawStandIn(painter, target, key, w, h);
+            }
+        }
+
+        if (!overlay.isNull())
+        {
+            double overlayScale = zoom * (1 << overlayLevel);
+            painter.setRenderHint(QPainter::SmoothPixmapTransform,
+                                  overlayScale < 1);
+            painter.drawImage(
+                QRectF(o.x() + overlayRect.x0 * overlayScale,
+                       o.y() + overlayRect.y0 * overlayScale,
+                       overlay.width() * overlayScale,
+                       overlay.height() * overlayScale),
+                overlay);
+        }
+
+        if (outline.size() > 1)
+        {
+            QPolygonF shape;
+            for (auto& point : outline)
+                shape.push_back(o + point * zoom);
+
+            painter.setBrush(Qt::NoBrush);
+            painter.setPen(QPen(Qt::black));
+            painter.drawPolygon(shape);
+            painter.setPen(QPen(Qt::white, 1, Qt::DashLine));
+            painter.drawPolygon(shape);
+        }
+
+        if (!missing.empty())
+            buildTiles(level, missing);
+    }
+
+    void wheelEvent(QWheelEvent* event) override
+    {
+        if (!pyramid)
+            return;
+
+        zoomAt(event->position(),
+               zoom * std::pow(1.25, event->angleDelta().y() / 120.0));
+        event->accept();
+    }
+
+    void mouseDoubleClickEvent(QMouseEvent* event) override
+    {
+        if (!pyramid)
+            return;
+
+        if (fit)
+        {
+            zoomAt(event->localPos(), 1.0);
+        }
+        else
+        {
+            fit = true;
+            updateLayout();
+        }
+    }
+
+    void mousePressEvent(QMouseEvent* event) override
+    {
+        if (event->button() == Qt::LeftButton && pyramid
+            && currentTool == Tool::Brush)
+        {
+            painting = true;
+            emit strokeMoved(imagePoint(event->localPos()));
+            return;
+        }
+
+        if (event->button() == Qt::LeftButton && pyramid
+            && currentTool != Tool::Pan)
+        {
+            selecting = true;
+            selectionStart = imagePoint(event->localPos());
+            outline = { selectionStart };
+            update();
+            return;
+        }
+
+        if (event->button() != Qt::LeftButton || fit)
+        {
+            QWidget::mousePressEvent(event);
+            return;
+        }
+
+        dragging = true;
+        dragPosition = event->globalPos();
+        setCursor(Qt::ClosedHandCursor);
+    }
+
+    void mouseMoveEvent(QMouseEvent* event) override
+    {
+        if (painting)
+        {
+            emit strokeMoved(imagePoint(event->localPos()));
+            return;
+        }
+
+        if (selecting)
+        {
+            extendSelection(imagePoint(event->localPos()));
+            return;
+        }
+
+        if (!dragging)
+            return;
+
+        auto delta = event->globalPos() - dragPosition;
+        dragPosition = event->globalPos();
+        area->horizontalScrollBar()->setValue(
+            area->horizontalScrollBar()->value() - delta.x());
+        area->verticalScrollBar()->setValue(
+            area->verticalScrollBar()->value() - delta.y());
+    }
+
+    void mouseReleaseEvent(QMouseEvent* event) override
+    {
+        if (painting)
+        {
+            painting = false;
+            emit strokeFinished();
+            return;
+        }
+
+        if (selecting)
+        {
+            selecting = false;
+            extendSelection(imagePoint(event->localPos()));
+
+            // A click without drag drops the selection
+            if (outline.size() < 3)
+                outline.clear();
+            update();
+            emit selectionChanged(outline);
+            return;
+        }
+
+        if (!dragging)
+        {
+            QWidget::mouseReleaseEvent(event);
+            return;
+        }
+
+        dragging = false;
+        unsetCursor();
+    }
+
+private:
+    /** Pyramid level and tile coordinates. */
+    using TileKey = std::tuple<int, int, int>;
+
+    struct Tile
+    {
+        QPixmap pixmap;
+        quint64 lastUse = 0;
+    };
+
+    static constexpr int tileSize = 256;
+    /** About 64 MB of 32-bit pixmaps. */
+    static constexpr std::size_t maxTiles = 256;
+
+    double fitZoom() const
+    {
+        auto& image = pyramid->base();
+        auto viewport = area->viewport()->size();
+        return std::min((double)viewport.width() / image.sx,
+                        (double)viewport.height() / image.sy);
+    }
+
+    /** Position of the image in the widget, centered when smaller. */
+    QPointF origin() const
+    {
+        auto& image = pyramid->base();
+        return QPointF(std::max(0.0, (width() - image.sx * zoom) / 2),
+                       std::max(0.0, (height() - image.sy * zoom) / 2));
+    }
+
+    /** Zooms keeping the image point under position in place. */
+    void zoomAt(QPointF position, double newZoom)
+    {
+        newZoom = std::min(newZoom, 32.0);
+        if (newZoom <= fitZoom())
+        {
+            fit = true;
+            updateLayout();
+            return;
+        }
+
+        auto hbar = area->horizontalScrollBar();
+        auto vbar = area->verticalScrollBar();
+        QPointF point = (position - origin()) / zoom;
+        QPointF inViewport = position - QPointF(hbar->value(), vbar->value());
+
+        fit = false;
+        zoom = newZoom;
+        updateLayout();
+
+        QPointF scroll = origin() + point * zoom - inViewport;
+        hbar->setValue(std::lround(scroll.x()));
+        vbar->setValue(std::lround(scroll.y()));
+    }
+
+    /** Pixel of level 0 under a widget position, clamped to the image. */
+    QPointF imagePoint(QPointF position) const
+    {
+        auto& image = pyramid->base();
+        QPointF point = (position - origin()) / zoom;
+        return QPointF(std::clamp<double>(point.x(), 0, image.sx),
+                       std::clamp<double>(point.y(), 0, image.sy));
+    }
+
+    /**
+     * Moves the free corner of a rectangle, snapped to whole pixels, or
+     * adds a point to a freehand outline.
+     */
+    void extendSelection(QPointF point)
+    {
+        if (currentTool == Tool::RectangleSelection)
+        {
+            QPointF start = selectionStart;
+            double x0 = std::floor(std::min(start.x(), point.x()));
+            double y0 = std::floor(std::min(start.y(), point.y()));
+            double x1 = std::ceil(std::max(start.x(), point.x()));
+            double y1 = std::ceil(std::max(start.y(), point.y()));
+
+            outline = { QPointF(x0, y0), QPointF(x1, y0), QPointF(x1, y1),
+                        QPointF(x0, y1) };
+        }
+        else
+        {
+            // Points closer than a display pixel add nothing to the outline
+            auto delta = (point - outline.back()) * zoom;
+            if (std::abs(delta.x()) + std::abs(delta.y()) < 1)
+                return;
+            outline.push_back(point);
+        }
+
+        update();
+    }
+
+    const QPixmap* findTile(std::map<TileKey, Tile>& cache, TileKey key)
+    {
+        auto tile = cache.find(key);
+        if (tile == cache.end())
+            return nullptr;
+
+        tile->second.lastUse = ++clock;
+        return &tile->second.pixmap;
+    }
+
+    /**
+     * Draws the tile of the previous image or the closest coarser tile
+     * cached in place of a missing one.
+     */
+    void drawStandIn(QPainter& painter, const QRectF& target, TileKey key,
+                     int w, int h)
     {
-        auto parentWidget = qobject_cast<QWidget*>(this->parent());
-        if (parentWidget)
+        auto [level, tx, ty] = key;
+
+        for (int k = 0; k <= 4; k++)
         {
-            auto parentSize = parentWidget->size();
-            QLabel::setPixmap(originalPixmap.scaled(
-                parentSize, Qt::KeepAspectRatio, Qt::SmoothTransformation));
+            double f = 1.0 / (1 << k);
+            double x = tx * tileSize * f;
+            double y = ty * tileSize * f;
+            TileKey coarse{ level + k, (int)x / tileSize, (int)y / tileSize };
+
+            for (auto cache : { &tiles, &staleTiles })
+            {
+                if (k == 0 && cache == &tiles)
+                    continue;
+
+                if (auto tile = findTile(*cache, coarse))
+                {
+                    QRectF source(x - std::get<1>(coarse) * tileSize,
+                                  y - std::get<2>(coarse) * tileSize, w * f,
+                                  h * f);
+                    painter.drawPixmap(target, *tile, source);
+                    return;
+                }
+            }
         }
     }
 
-    void setPixmap(const QPixmap& p)
+    /** Cuts the bounding box of the missing tiles on the worker. */
+    void buildTiles(int level, const std::vector<TileKey>& missing)
+    {
+        int tx0 = std::get<1>(missing.front());
+        int ty0 = std::get<2>(missing.front());
+        int tx1 = tx0;
+        int ty1 = ty0;
+        for (auto [l, tx, ty] : missing)
+        {
+            tx0 = std::min(tx0, tx);
+            ty0 = std::min(ty0, ty);
+            tx1 = std::max(tx1, tx);
+            ty1 = std::max(ty1, ty);
+        }
+
+        // The pending job is replaced, not queued: keep what it was cutting
+        tifo::image_rect tilesRect{ tx0, ty0, tx1 + 1, ty1 + 1 };
+        if (buildJob != 0 && buildLevel == level)
+        {
+            if (buildTilesRect.intersected(tilesRect) == tilesRect)
+                return;
+            tilesRect = tilesRect.united(buildTilesRect);
+            tx0 = tilesRect.x0;
+            ty0 = tilesRect.y0;
+            tx1 = tilesRect.x1 - 1;
+            ty1 = tilesRect.y1 - 1;
+        }
+
+        auto pyramid = this->pyramid;
+        buildLevel = level;
+        buildTilesRect = tilesRect;
+        buildJob = builder->submit(
+            pyramid->level(0), [=](const tifo::rgb24_image&) {
+                auto image = pyramid->level(level);
+                auto rect =
+                    tifo::image_rect{ tx0 * tileSize, ty0 * tileSize,
+                                      (tx1 + 1) * tileSize,
+                                      (ty1 + 1) * tileSize }
+                        .intersected({ 0, 0, image->sx, image->sy });
+                return tifo::crop(*image, rect);
+            });
+    }
+
+    void tilesBuilt(quint64 id, ImagePtr result, qint64)
+    {
+        if (id != buildJob)
+            return;
+
+        buildJob = 0;
+        QImage image = rgb_to_qimage(*result);
+
+        for (int ty = buildTilesRect.y0; ty < buildTilesRect.y1; ty++)
+        {
+            for (int tx = buildTilesRect.x0; tx < buildTilesRect.x1; tx++)
+            {
+                QRect rect((tx - buildTilesRect.x0) * tileSize,
+                           (ty - buildTilesRect.y0) * tileSize, tileSize,
+                           tileSize);
+                auto& tile = tiles[{ buildLevel, tx, ty }];
+                tile.pixmap = QPixmap::fromImage(
+                    image.copy(rect.intersected(image.rect())));
+                tile.lastUse = ++clock;
+            }
+        }
+
+        while (tiles.size() > maxTiles)
+        {
+            auto oldest = tiles.begin();
+            for (auto tile = tiles.begin(); tile != tiles.end(); tile++)
+            {
+                if (tile->second.lastUse < oldest->second.lastUse)
+                    oldest = tile;
+            }
+            tiles.erase(oldest);
+        }
+
+        update();
+    }
+
+    ResizableScrollArea* area;
+    std::shared_ptr<tifo::image_pyramid> pyramid;
+    bool fit = true;
+    /** Display pixels per image pixel. */
+    double zoom = 1;
+
+    std::map<TileKey, Tile> tiles;
+    /** Tiles of the previous image of the same size, as stand-ins. */
+    std::map<TileKey, Tile> staleTiles;
+    quint64 clock = 0;
+
+    EditorWorker* builder;
+    quint64 buildJob = 0;
+    int buildLevel = 0;
+    tifo::image_rect buildTilesRect;
+
+    QImage overlay;
+    tifo::image_rect overlayRect;
+    int overlayLevel = 0;
+
+    bool dragging = false;
+    QPoint dragPosition;
+
+    Tool currentTool = Tool::Pan;
+    bool selecting = false;
+    bool painting = false;
+    QPointF selectionStart;
+    /** Outline of the selection, in pixels of level 0. */
+    QPolygonF outline;
+};
+
+/**
+ * Shows the scopes of the displayed image, rendered by tifo::histogram_scope
+ * and tifo::waveform_scope, stretched over the widget.
+ */
+class ScopeView : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit ScopeView(QWidget* parent = nullptr)
+        : QWidget(parent)
+    {}
+
+    void setScope(const tifo::rgb24_image& image)
+    {
+        scope = rgb_to_qimage(image);
+        update();
+    }
+
+signals:
+    /** The scopes are only computed while they can be seen. */
+    void shown();
+
+protected:
+    void paintEvent(QPaintEvent*) override
+    {
+        if (scope.isNull())
+            return;
+
+        QPainter painter(this);
+        painter.drawImage(rect(), scope);
+    }
+
+    void showEvent(QShowEvent* event) override
     {
-        originalPixmap = p;
-        updatePixmap();
+        QWidget::showEvent(event);
+        emit shown();
     }
 
 private:
-    QPixmap originalPixmap;
+    QImage scope;
 };
 
 class MainWindow : public QWidget
@@ -154,9 +807,14 @@ public:
 
         // Image area
         ResizableScrollArea* scrollArea = new ResizableScrollArea;
-        m_imageLabel = new ResizableImageLabel(scrollArea);
-        scrollArea->setWidgetResizable(true);
-        scrollArea->setWidget(m_imageLabel);
+        m_imageViewer = new ImageViewer(scrollArea);
+        connect(m_imageViewer, &ImageViewer::selectionChanged, this,
+                &MainWindow::setSelection);
+        connect(m_imageViewer, &ImageViewer::strokeMoved, this,
+                &MainWindow::paintStroke);
+        connect(m_imageViewer, &ImageViewer::strokeFinished, this,
+                &MainWindow::applyStroke);
+        scrollArea->setWidget(m_imageViewer);
         imageAndOptionsLayout->addWidget(scrollArea);
 
         // Options area
@@ -172,45 +830,898 @@ public:
         optionsScrollArea->setWidgetResizable(true);
         imageAndOptionsLayout->addWidget(optionsScrollArea);
 
+        // Status bar
+        statusBar = new QStatusBar;
+        progressBar = new QProgressBar;
+        progressBar->setRange(0, 100);
+        progressBar->setMaximumWidth(200);
+        progressBar->setVisible(false);
+        memoryLabel = new QLabel;
+        statusBar->addPermanentWidget(memoryLabel);
+        statusBar->addPermanentWidget(progressBar);
+        mainLayout->addWidget(statusBar);
+
+        // Background processing
+        worker = new EditorWorker(this);
+        connect(worker, &EditorWorker::progress, this,
+                &MainWindow::jobProgress);
+        connect(worker, &EditorWorker::finished, this,
+                &MainWindow::jobFinished);
+        connect(worker, &EditorWorker::failed, this, &MainWindow::jobFailed);
+        worker->start();
+
+        // Slider previews run on their own worker so that they never cancel
+        // an operation being applied
+        previewWorker = new EditorWorker(this);
+        connect(previewWorker, &EditorWorker::finished, this,
+                &MainWindow::previewFinished);
+        connect(previewWorker, &EditorWorker::failed, this,
+                &MainWindow::previewFailed);
+        previewWorker->start();
+
+        // At most one proxy preview per display refresh while dragging
+        previewTimer = new QTimer(this);
+        previewTimer->setSingleShot(true);
+        previewTimer->setInterval(16);
+        connect(previewTimer, &QTimer::timeout, this, &MainWindow::runPreview);
+
+        // Idle time pre-renders the next values of the dragged slider
+        speculativeWorker = new EditorWorker(this, true);
+        connect(speculativeWorker, &EditorWorker::finished, this,
+                &MainWindow::speculationFinished);
+        connect(speculativeWorker, &EditorWorker::failed, this,
+                [this](quint64 id) {
+                    if (id == speculativeJob)
+                        speculativeJob = 0;
+                });
+        speculativeWorker->start(QThread::LowestPriority);
+
+        // Scopes follow the display, one computation at a time
+        scopeWorker = new EditorWorker(this);
+        connect(scopeWorker, &EditorWorker::finished, this,
+                &MainWindow::scopeFinished);
+        connect(scopeWorker, &EditorWorker::failed, this,
+                [this](quint64 id) {
+                    if (id != scopeJob)
+                        return;
+                    scopeJob = 0;
+                    runScope();
+                });
+        scopeWorker->start();
+
+        /**
+         ** SCOPES PART
+         **/
+        addPanel(optionsLayout, "Scopes", 600,
+                 [this](QGroupBox* group) { buildScopesPanel(group); });
+
+        /**
+         ** TOOLS PART
+         **/
+        addPanel(optionsLayout, "Tools", 200,
+                 [this](QGroupBox* group) { buildToolsPanel(group); });
+
+        /**
+         ** BRUSH PART
+         **/
+        addPanel(optionsLayout, "Brush", 400,
+                 [this](QGroupBox* group) { buildBrushPanel(group); });
+
         /**
          ** FILTERS PART
          **/
+        addPanel(optionsLayout, "Filters", 800,
+                 [this](QGroupBox* group) { buildFiltersPanel(group); });
+
+        /**
+         ** FLIP
+         **/
+        addPanel(optionsLayout, "Flip", 100,
+                 [this](QGroupBox* group) { buildFlipPanel(group); });
 
-        QPushButton* toggleFiltersButton = new QPushButton("> Filters");
-        optionsLayout->addWidget(toggleFiltersButton);
+        /**
+         ** ROTATE PART
+         **/
+        addPanel(optionsLayout, "Rotate", 200,
+                 [this](QGroupBox* group) { buildRotatePanel(group); });
 
-        QGroupBox* FiltersGroup = new QGroupBox();
-        FiltersGroup->setMaximumHeight(800);
-        FiltersGroup->setCheckable(false); // Not checkable
-        FiltersGroup->setVisible(false); // Initially not visible
-        optionsLayout->addWidget(FiltersGroup);
+        /**
+         ** SWAP CHANNELS PART
+         **/
+        addPanel(optionsLayout, "RGB Swap", 100,
+                 [this](QGroupBox* group) { buildSwapChannelsPanel(group); });
 
+        /**
+         ** RGB INCREASING
+         **/
+        addPanel(optionsLayout, "RGB", 400,
+                 [this](QGroupBox* group) { buildChannelsPanel(group); });
+
+        /**
+         ** HSV INCREASING
+         **/
+        addPanel(optionsLayout, "HSV", 400,
+                 [this](QGroupBox* group) { buildHSVPanel(group); });
+
+        /**
+         ** YCrCb INCREASING
+         **/
+        addPanel(optionsLayout, "YCrCb", 400,
+                 [this](QGroupBox* group) { buildYCrCbPanel(group); });
+
+        /**
+         ** PROCESSING OPTIONS PART
+         **/
+        addPanel(optionsLayout, "Options", 500,
+                 [this](QGroupBox* group) { buildOptionsPanel(group); });
+
+        /**
+         ** EDITS PART
+         **/
+
+        QPushButton* toggleEditsButton = new QPushButton("> Edits");
+        optionsLayout->addWidget(toggleEditsButton);
+
+        QGroupBox* editsGroup = new QGroupBox();
+        editsGroup->setCheckable(false); // Not checkable
+        editsGroup->setVisible(false); // Initially not visible
+        optionsLayout->addWidget(editsGroup);
+
+        QVBoxLayout* editsLayout = new QVBoxLayout;
+        editsGroup->setLayout(editsLayout);
+
+        // Unchecking a step skips it, the later ones are computed again
+        stepsList = new QListWidget;
+        connect(stepsList, &QListWidget::itemChanged, this,
+                [this](QListWidgetItem* item) {
+                    toggleStep(stepsList->row(item),
+                               item->checkState() == Qt::Checked);
+                });
+        editsLayout->addWidget(stepsList);
+
+        QPushButton* editStepButton =
+            new QPushButton("Edit selected step", this);
+        connect(editStepButton, &QPushButton::clicked, this, [this]() {
+            int row = stepsList->currentRow();
+            if (row < 0)
+                return;
+
+            editingStep = row;
+            statusBar->showMessage(
+                QString("Editing step %1: the next applied operation "
+                        "replaces it")
+                    .arg(row + 1));
+        });
+        editsLayout->addWidget(editStepButton);
+
+        connect(toggleEditsButton, &QPushButton::clicked, [=]() {
+            bool isVisible = editsGroup->isVisible();
+            editsGroup->setVisible(!isVisible);
+            if (isVisible)
+            {
+                toggleEditsButton->setText("> Edits");
+            }
+            else
+            {
+                toggleEditsButton->setText("V Edits");
+            }
+        });
+    }
+
+public slots:
+    void loadImage()
+    {
+        QString fileName = QFileDialog::getOpenFileName(
+            this, "Open Image", "", "Image Files (*.png *.jpg *.bmp *.tga)");
+        if (!fileName.isEmpty())
+        {
+            cancelPending();
+
+            QImage loaded;
+            loaded.load(fileName);
+            index = 0;
+            editingStep = -1;
+            previewCache.clear();
+            setSelection({});
+            m_imageViewer->clearSelection();
+            history.reset(ImagePtr(qimage_to_rgb(loaded)));
+            showState();
+            saveButton->setEnabled(true);
+            backwardButton->setEnabled(true);
+            forwardButton->setEnabled(true);
+            originalButton->setEnabled(true);
+            optionsWidget->setEnabled(true);
+        }
+    }
+
+    /**
+     * Matches the histograms of the image to those of a reference image,
+     * channel by channel, or to a gray level histogram saved by save_hist.
+     */
+    void matchHistogram()
+    {
+        QString fileName = QFileDialog::getOpenFileName(
+            this, "Reference", "",
+            "Images or histograms (*.png *.jpg *.bmp *.tga *.txt)");
+        if (fileName.isEmpty())
+            return;
+
+        if (fileName.endsWith(".txt"))
+        {
+            tifo::histogram_1d reference;
+            try
+            {
+                reference = tifo::load_hist(fileName.toStdString().c_str());
+            }
+            catch (const std::runtime_error& error)
+            {
+                QMessageBox::information(this, tr("ERROR"), error.what());
+                return;
+            }
+            applyOperation(tifo::match_luma, "Match Histogram", reference);
+            return;
+        }
+
+        QImage loaded;
+        if (!loaded.load(fileName))
+        {
+            QMessageBox::information(this, tr("ERROR"),
+                                     tr("Cannot open the reference"));
+            return;
+        }
+        std::unique_ptr<tifo::rgb24_image> reference(qimage_to_rgb(loaded));
+        applyOperation(tifo::match_channels, "Match Histogram",
+                       tifo::rgb_histograms(*reference));
+    }
+
+    void saveImage()
+    {
+        QString fileName = QFileDialog::getSaveFileName(
+            this, "Save Image", "",
+            "PNG (*.png);;JPEG (*.jpg *.jpeg);;BMP (*.bmp)");
+        if (!fileName.isEmpty())
+        {
+            auto image = history.get(index);
+            if (!image)
+            {
+                statusBar->showMessage("The current state is being computed",
+                                       5000);
+                return;
+            }
+
+            rgb_to_qimage(*image, m_image);
+            m_image.save(fileName);
+        }
+    }
+
+    void backwardImage()
+    {
+        qDebug() << index;
+
+        cancelPending();
+
+        if (index > 0 && index <= history.size() - 1)
+        {
+            index--;
+
+            qDebug() << index;
+
+            showState();
+        }
+    }
+
+    void forwardImage()
+    {
+        qDebug() << index;
+
+        cancelPending();
+
+        if (index != history.size() - 1)
+        {
+            qDebug() << index;
+
+            index++;
+
+            showState();
+        }
+    }
+
+    void originalImage()
+    {
+        cancelPending();
+
+        index = 0;
+        editingStep = -1;
+
+        history.truncate(1);
+        showState();
+    }
+
+    /**
+     * Wraps a tifo:: operation and its arguments into a worker operation.
+     * Operations either work in place (void(rgb24_image&, args...)) and then
+     * run on a copy of the source, or return a freshly allocated image
+     * (rgb24_image*(const rgb24_image&, args...)), like rotate_image.
+     */
+    template <typename Processing, typename... Args>
+    static EditorWorker::Operation bindOperation(Processing&& processing,
+                                                 Args... args)
+    {
+        return [processing, args...](const tifo::rgb24_image& source) {
+            if constexpr (std::is_same_v<
+                              std::invoke_result_t<Processing,
+                                                   tifo::rgb24_image&, Args...>,
+                              tifo::rgb24_image*>)
+            {
+                return processing(source, args...);
+            }
+            else
+            {
+                auto result = new tifo::rgb24_image(source);
+                try
+                {
+                    processing(*result, args...);
+                }
+                catch (...)
+                {
+                    delete result;
+                    throw;
+                }
+                return result;
+            }
+        };
+    }
+
+    template <typename Processing, typename... Args>
+    void applyOperation(Processing&& processing, const char* str,
+                        Args... args)
+    {
+        submitOperation(str, bindOperation(processing, args...));
+    }
+
+    /**
+     * Same as applyOperation for an operation that is its own inverse, which
+     * the history then does not need to store.
+     */
+    template <typename Processing, typename... Args>
+    void applyInvolution(Processing&& processing, const char* str,
+                         Args... args)
+    {
+        auto operation = bindOperation(processing, args...);
+        submitOperation(str, operation, nullptr, operation);
+    }
+
+    /**
+     * Same as applyOperation for an operation reading the pixels up to halo
+     * pixels away from the ones it computes, which a selection must include.
+     */
+    template <typename Processing, typename... Args>
+    void applyStencil(int halo, Processing&& processing, const char* str,
+                      Args... args)
+    {
+        submitOperation(str, bindOperation(processing, args...), nullptr,
+                        nullptr, halo);
+    }
+
+    /**
+     * Queues the operation on the current history state. Its result becomes
+     * the next state only if no newer request was made meanwhile; onApplied
+     * then runs on the GUI thread. When a step is being edited, the
+     * operation replaces it instead. inverse undoes the operation, if known.
+     *
+     * With a selection, only the selected pixels are computed, reading halo
+     * pixels around them; operations with a halo of wholeImage (geometric
+     * or position dependent ones) ignore it. changed bounds the pixels the
+     * operation modifies, when known.
+     */
+    void submitOperation(const char* str, EditorWorker::Operation operation,
+                         std::function<void()> onApplied = nullptr,
+                         EditorWorker::Operation inverse = nullptr,
+                         int halo = 0,
+                         std::optional<tifo::image_rect> changed = std::nullopt)
+    {
+        if (history.empty())
+            return;
+
+        if (selection && halo != wholeImage)
+        {
+            operation = inSelection(std::move(operation), halo);
+            // Blending partly covered pixels twice does not restore them
+            inverse = nullptr;
+        }
+
+        if (editingStep >= 0 && editingStep < (int)history.size() - 1)
+        {
+            cancelPending();
+            history.replace(editingStep, str, std::move(operation),
+                            std::move(inverse));
+            editingStep = -1;
+
+            if (onApplied)
+                onApplied();
+
+            showState();
+            return;
+        }
+        editingStep = -1;
+
+        auto source = history.get(index);
+        if (!source)
+        {
+            statusBar->showMessage("The current state is being computed",
+                                   5000);
+            return;
+        }
+
+        startJob(str, source, operation,
+                 [=, this](ImagePtr result, qint64 elapsed) {
+                     if (onApplied)
+                         onApplied();
+
+                     history.apply(index, { str, operation, inverse, true,
+                                            (double)elapsed },
+                                   result, changed);
+                     index++;
+
+                     showImage(result);
+                     refreshSteps();
+                     updateMemoryUsage();
+
+                     statusBar->showMessage(QString("%1 applied in %2 ms")
+                                                .arg(str)
+                                                .arg(elapsed),
+                                            5000);
+                 });
+    }
+
+    /**
+     * Runs a job on the editor worker. Only the newest one completes, on
+     * the GUI thread.
+     */
+    void startJob(const char* str, ConstImagePtr source,
+                  EditorWorker::Operation operation,
+                  std::function<void(ImagePtr, qint64)> completion)
+    {
+        cancelPreview();
+
+        jobTimer.start();
+        jobName = str;
+        jobCompletion = std::move(completion);
+        latestJob = worker->submit(std::move(source), std::move(operation));
+
+        progressBar->setValue(0);
+        progressBar->setVisible(true);
+        statusBar->showMessage(QString("%1...").arg(str));
+    }
+
+    void jobProgress(quint64 id, int percent)
+    {
+        if (id == latestJob)
+            progressBar->setValue(percent);
+    }
+
+    void jobFinished(quint64 id, ImagePtr result, qint64 elapsed)
+    {
+        // Stale result: a newer request or a history move superseded it
+        if (id != latestJob)
+            return;
+
+        latestJob = 0;
+        progressBar->setVisible(false);
+
+        qDebug() << jobName << " execution time: " << elapsed << "ms";
+        qDebug() << "Whole " << jobName
+                 << " process execution time: " << jobTimer.elapsed() << "ms";
+
+        auto completion = std::move(jobCompletion);
+        completion(result, elapsed);
+    }
+
+    void runPreview()
+    {
+        if (!pendingPreview || history.empty() || !history.contains(index))
+            return;
+
+        // A dragged slider keeps one proxy preview in flight, the newest
+        // request waits for it; a released one preempts it
+        if (previewJob != 0 && !pendingFullResolution)
+            return;
+
+        int level = pendingFullResolution ? 0 : previewLevel();
+        auto operation = pendingPreview(pendingValue, 1.0f / (1 << level));
+        pendingPreview = nullptr;
+
+        if (!operation)
+            return;
+
+        previewKey = previewKeyFor(pendingSlider, pendingValue, level);
+        previewIsProxy = !pendingFullResolution;
+        previewJob = submitPreview(previewWorker, previewKey, operation);
+    }
+
+    void previewFinished(quint64 id, ImagePtr result, qint64)
+    {
+        if (id != previewJob)
+            return;
+
+        previewJob = 0;
+
+        if (previewIsProxy)
+            previewCache.insert(previewKey, result);
+
+        // Applied operations and history moves take over the display
+        if (latestJob == 0 && !history.empty()
+            && history.id(index) == previewKey.state)
+        {
+            showPreview(result, previewKey);
+        }
+
+        if (!pendingPreview)
+            speculate();
+        else if (!previewTimer->isActive())
+            runPreview();
+    }
+
+    void previewFailed(quint64 id, QString reason)
+    {
+        if (id != previewJob)
+            return;
+
+        previewJob = 0;
+        statusBar->showMessage(QString("Preview failed: %1").arg(reason),
+                               5000);
+    }
+
+    void speculationFinished(quint64 id, ImagePtr result, qint64)
+    {
+        if (id != speculativeJob)
+            return;
+
+        speculativeJob = 0;
+        previewCache.insert(std::move(speculativeKey), result);
+        speculate();
+    }
+
+    void scopeFinished(quint64 id, ImagePtr result, qint64)
+    {
+        if (id != scopeJob)
+            return;
+
+        scopeJob = 0;
+        scopeView->setScope(*result);
+        runScope();
+    }
+
+    void jobFailed(quint64 id, QString reason)
+    {
+        if (id != latestJob)
+            return;
+
+        latestJob = 0;
+        progressBar->setVisible(false);
+        statusBar->showMessage(QString("%1 failed: %2").arg(jobName, reason),
+                               5000);
+    }
+
+private:
+    /**
+     * Restricts the next operations to the inside of an outline drawn on
+     * the viewer, in pixels of the image; an empty one selects everything.
+     */
+    void setSelection(const QPolygonF& outline)
+    {
+        selection.reset();
+        previewCache.clear();
+
+        if (history.empty() || !history.contains(index) || outline.empty())
+            return;
+
+        auto image = history.get(index);
+        tifo::selection selected;
+        if (m_imageViewer->tool() == ImageViewer::Tool::RectangleSelection)
+        {
+            auto bounds = outline.boundingRect();
+            selected = tifo::rect_selection(
+                { (int)bounds.left(), (int)bounds.top(), (int)bounds.right(),
+                  (int)bounds.bottom() },
+                image->sx, image->sy);
+        }
+        else
+        {
+            std::vector<tifo::outline_point> points;
+            for (auto& point : outline)
+                points.push_back({ (float)point.x(), (float)point.y() });
+            selected = tifo::freehand_selection(points, image->sx, image->sy);
+        }
+
+        if (selected.empty())
+        {
+            m_imageViewer->clearSelection();
+            return;
+        }
+
+        selection =
+            std::make_shared<const tifo::selection>(std::move(selected));
+    }
+
+    /**
+     * Wraps an operation so that it only computes the pixels of the current
+     * selection, reading halo pixels around them.
+     */
+    EditorWorker::Operation inSelection(EditorWorker::Operation operation,
+                                        int halo) const
+    {
+        return [operation, halo, selection = selection](
+                   const tifo::rgb24_image& source) {
+            return tifo::apply_in_selection(source, *selection, halo,
+                                            operation);
+        };
+    }
+
+    /**
+     * Adds a point to the brush stroke being painted. Only the tiles of the
+     * display level touched by the new segment are rendered again, on the
+     * GUI thread, and the stroke is shown over the image.
+     */
+    void paintStroke(QPointF point)
+    {
+        if (!stroke)
+        {
+            if (history.empty() || !history.contains(index) || latestJob != 0)
+                return;
+
+            cancelPreview();
+            stroke = tifo::brush_stroke{ brushEffect, brushAmount,
+                                         (float)brushRadius,
+                                         brushHardness / 100.0f, {} };
+            strokeLevel = previewLevel();
+            strokeSource = currentProxies()->level(strokeLevel);
+            strokeCanvas = std::make_shared<tifo::rgb24_image>(*strokeSource);
+            strokeRect = {};
+        }
+
+        stroke->points.push_back({ (float)point.x(), (float)point.y() });
+
+        auto scaled = stroke->at_level(strokeLevel);
+        auto tiles = tifo::stroke_tiles(scaled, strokeCanvas->sx,
+                                        strokeCanvas->sy,
+                                        scaled.points.size() - 1);
+        if (tiles.empty())
+            return;
+
+        tifo::render_stroke(*strokeSource, *strokeCanvas, scaled, tiles);
+        for (auto& tile : tiles)
+            strokeRect = strokeRect.united(tile);
+
+        std::unique_ptr<tifo::rgb24_image> shown(
+            tifo::crop(*strokeCanvas, strokeRect));
+        m_imageViewer->setOverlay(*shown, strokeRect, strokeLevel);
+    }
+
+    /**
+     * Applies the finished stroke at full resolution. Its tiles bound the
+     * change, which the history then stores as a rectangle.
+     */
+    void applyStroke()
+    {
+        if (!stroke)
+            return;
+
+        auto finished = std::move(*stroke);
+        stroke.reset();
+        strokeSource.reset();
+        strokeCanvas.reset();
+
+        auto image = history.get(index);
+        if (!image)
+            return;
+
+        tifo::image_rect changed;
+        for (auto& tile : tifo::stroke_tiles(finished, image->sx, image->sy))
+            changed = changed.united(tile);
+        if (changed.empty())
+            return;
+
+        submitOperation(
+            "Brush",
+            [finished](const tifo::rgb24_image& source) {
+                return tifo::apply_stroke(source, finished);
+            },
+            nullptr, nullptr, wholeImage, changed);
+    }
+
+    /**
+     * Adds a collapsed panel under a toggle button to the options. Its
+     * contents are only built by build when it is first expanded, which
+     * keeps them out of the startup.
+     */
+    void addPanel(QVBoxLayout* optionsLayout, const QString& title,
+                  int maximumHeight, std::function<void(QGroupBox*)> build)
+    {
+        QPushButton* toggleButton = new QPushButton("> " + title);
+        optionsLayout->addWidget(toggleButton);
+
+        QGroupBox* group = new QGroupBox();
+        if (maximumHeight > 0)
+            group->setMaximumHeight(maximumHeight);
+        group->setVisible(false);
+        optionsLayout->addWidget(group);
+
+        connect(toggleButton, &QPushButton::clicked,
+                [=, built = false]() mutable {
+                    if (!built)
+                    {
+                        build(group);
+                        built = true;
+                    }
+
+                    bool visible = !group->isVisible();
+                    group->setVisible(visible);
+                    toggleButton->setText((visible ? "V " : "> ") + title);
+                });
+    }
+
+    void buildScopesPanel(QGroupBox* group)
+    {
+        QVBoxLayout* scopesLayout = new QVBoxLayout;
+        group->setLayout(scopesLayout);
+
+        scopeView = new ScopeView;
+        scopeView->setFixedHeight(scopeHeight);
+        connect(scopeView, &ScopeView::shown, this,
+                &MainWindow::refreshScopes);
+        scopesLayout->addWidget(scopeView);
+
+        waveformBox = new QCheckBox("Waveform");
+        connect(waveformBox, &QCheckBox::toggled, this, [this](bool checked) {
+            scopeView->setFixedHeight(checked ? 2 * scopeHeight
+                                              : scopeHeight);
+            refreshScopes();
+        });
+        scopesLayout->addWidget(waveformBox);
+    }
+
+    void buildToolsPanel(QGroupBox* group)
+    {
+        QVBoxLayout* selectionLayout = new QVBoxLayout;
+
+        QRadioButton* panButton = new QRadioButton("Move");
+        QRadioButton* rectangleButton = new QRadioButton("Rectangle");
+        QRadioButton* freehandButton = new QRadioButton("Freehand");
+        QRadioButton* brushButton = new QRadioButton("Brush");
+        panButton->setChecked(true);
+
+        connect(panButton, &QRadioButton::clicked, this, [this]() {
+            m_imageViewer->setTool(ImageViewer::Tool::Pan);
+        });
+        connect(rectangleButton, &QRadioButton::clicked, this, [this]() {
+            m_imageViewer->setTool(ImageViewer::Tool::RectangleSelection);
+        });
+        connect(freehandButton, &QRadioButton::clicked, this, [this]() {
+            m_imageViewer->setTool(ImageViewer::Tool::FreehandSelection);
+        });
+        connect(brushButton, &QRadioButton::clicked, this, [this]() {
+            m_imageViewer->setTool(ImageViewer::Tool::Brush);
+        });
+
+        selectionLayout->addWidget(panButton);
+        selectionLayout->addWidget(rectangleButton);
+        selectionLayout->addWidget(freehandButton);
+        selectionLayout->addWidget(brushButton);
+
+        QPushButton* clearButton = new QPushButton("Clear selection", this);
+        connect(clearButton, &QPushButton::clicked, this, [this]() {
+            setSelection({});
+            m_imageViewer->clearSelection();
+        });
+        selectionLayout->addWidget(clearButton);
+
+        group->setLayout(selectionLayout);
+    }
+
+    void buildBrushPanel(QGroupBox* group)
+    {
+        QVBoxLayout* brushLayout = new QVBoxLayout;
+
+        QComboBox* effectBox = new QComboBox;
+        for (auto name : { "Dodge", "Burn", "Saturation", "Contrast", "Blur" })
+            effectBox->addItem(name);
+        effectBox->setCurrentIndex((int)brushEffect);
+        connect(effectBox, QOverload<int>::of(&QComboBox::currentIndexChanged),
+                this, [this](int index) {
+                    brushEffect = static_cast<tifo::brush_effect>(index);
+                });
+        brushLayout->addWidget(effectBox);
+
+        // Each setting is a slider with its value shown below
+        auto addSetting = [&](const QString& name, int minimum, int maximum,
+                              int* setting) {
+            QHBoxLayout* sliderLayout = new QHBoxLayout;
+            QSlider* slider = new QSlider(Qt::Horizontal);
+            slider->setRange(minimum, maximum);
+            slider->setValue(*setting);
+            slider->setMaximumWidth(300);
+
+            sliderLayout->addWidget(new QLabel(QString::number(minimum)));
+            sliderLayout->addWidget(slider);
+            sliderLayout->addWidget(new QLabel(QString::number(maximum)));
+
+            QLabel* value =
+                new QLabel(QString("%1: %2").arg(name).arg(*setting));
+            connect(slider, &QSlider::valueChanged, this, [=](int current) {
+                *setting = current;
+                value->setText(QString("%1: %2").arg(name).arg(current));
+            });
+
+            brushLayout->addLayout(sliderLayout);
+            brushLayout->addWidget(value);
+        };
+
+        addSetting("Size", 1, 200, &brushRadius);
+        addSetting("Hardness", 0, 100, &brushHardness);
+        addSetting("Amount", -100, 100, &brushAmount);
+
+        group->setLayout(brushLayout);
+    }
+
+    void buildFiltersPanel(QGroupBox* group)
+    {
         QVBoxLayout* filtersCheckBoxLayout = new QVBoxLayout;
-        FiltersGroup->setLayout(filtersCheckBoxLayout);
+        group->setLayout(filtersCheckBoxLayout);
 
         QPushButton* filmFilterButton = new QPushButton("Film Filter", this);
         connect(filmFilterButton, &QPushButton::clicked, this, [this]() {
-            applyFilter(tifo::argentique_filter, "Argentique");
+            applyOperation(tifo::argentique_filter, "Argentique");
         });
         filtersCheckBoxLayout->addWidget(filmFilterButton);
 
         QPushButton* IRfilterButton = new QPushButton("IR Filter", this);
         connect(IRfilterButton, &QPushButton::clicked, this,
-                [this]() { applyFilter(tifo::ir_filter, "IR"); });
+                [this]() { applyOperation(tifo::ir_filter_fused, "IR"); });
         filtersCheckBoxLayout->addWidget(IRfilterButton);
 
         QPushButton* negativeFilterButton =
             new QPushButton("Negative Filter", this);
-        connect(negativeFilterButton, &QPushButton::clicked, this,
-                [this]() { applyFilter(tifo::negative_filter, "Negative"); });
+        connect(negativeFilterButton, &QPushButton::clicked, this, [this]() {
+            applyInvolution(tifo::negative_filter, "Negative");
+        });
         filtersCheckBoxLayout->addWidget(negativeFilterButton);
 
         QPushButton* grayscaleFilterButton =
             new QPushButton("Grayscale Filter", this);
         connect(grayscaleFilterButton, &QPushButton::clicked, this,
-                [this]() { applyFilter(tifo::grayscale, "Grayscale"); });
+                [this]() { applyOperation(tifo::grayscale, "Grayscale"); });
         filtersCheckBoxLayout->addWidget(grayscaleFilterButton);
 
+        QPushButton* equalizeButton = new QPushButton("Equalize", this);
+        connect(equalizeButton, &QPushButton::clicked, this, [this]() {
+            applyOperation(tifo::luma_equalize, "Equalize");
+        });
+        filtersCheckBoxLayout->addWidget(equalizeButton);
+
+        QPushButton* claheButton = new QPushButton("Local Equalize", this);
+        connect(claheButton, &QPushButton::clicked, this, [this]() {
+            applyOperation(tifo::clahe, "Local Equalize", 8, 2.0f);
+        });
+        filtersCheckBoxLayout->addWidget(claheButton);
+
+        QPushButton* autoLevelsButton = new QPushButton("Auto Levels", this);
+        connect(autoLevelsButton, &QPushButton::clicked, this, [this]() {
+            applyOperation(tifo::auto_levels, "Auto Levels", 0.5f);
+        });
+        filtersCheckBoxLayout->addWidget(autoLevelsButton);
+
+        QPushButton* matchButton = new QPushButton("Match Histogram...", this);
+        connect(matchButton, &QPushButton::clicked, this,
+                &MainWindow::matchHistogram);
+        filtersCheckBoxLayout->addWidget(matchButton);
+
+        QPushButton* medianButton = new QPushButton("Median Denoise", this);
+        connect(medianButton, &QPushButton::clicked, this, [this]() {
+            applyStencil(2, tifo::median_filter, "Median", 2);
+        });
+        filtersCheckBoxLayout->addWidget(medianButton);
+
         // GLOW FILTER
 
         QVBoxLayout* glowFilterLayout = new QVBoxLayout;
@@ -277,11 +1788,20 @@ public:
         QPushButton* glowFilterButton =
             new QPushButton("Apply glow filter", this);
         connect(glowFilterButton, &QPushButton::clicked, this, [=, this]() {
-            applyGlow(tifo::glow_filter, (float)glowRadius_value,
-                      glowThreshold_value, "Glow");
+            applyStencil(2, tifo::glow_filter_fused, "Glow",
+                         (float)glowRadius_value, glowThreshold_value);
         });
         glowFilterLayout->addWidget(glowFilterButton);
 
+        connectPreview(glowRadiusSlider, [=](int value, float scale) {
+            return bindOperation(tifo::glow_filter_fused, value * scale,
+                                 glowThresholdSlider->value());
+        }, 2);
+        connectPreview(glowThresholdSlider, [=](int value, float scale) {
+            return bindOperation(tifo::glow_filter_fused,
+                                 glowRadiusSlider->value() * scale, value);
+        }, 2);
+
         filtersCheckBoxLayout->addLayout(glowFilterLayout);
 
         // GAUSSIAN BLUR
@@ -357,12 +1877,30 @@ public:
                                          tr("The size must be odd"));
             else
             {
-                applyGaussian(tifo::rgb_gaussian, gaussianSize_value,
-                              (float)gaussianRadius_value, "Gaussian");
+                applyStencil(gaussianSize_value / 2, tifo::rgb_gaussian,
+                             "Gaussian", gaussianSize_value,
+                             (float)gaussianRadius_value);
             }
         });
         gaussianFilterLayout->addWidget(gaussianFilterButton);
 
+        connectPreview(gaussianSizeSlider,
+                       [=](int value, float scale) -> EditorWorker::Operation {
+                           if (value % 2 == 0)
+                               return nullptr;
+                           return bindOperation(
+                               tifo::rgb_gaussian, value,
+                               gaussianRadiusSlider->value() * scale);
+                       }, 4);
+        connectPreview(gaussianRadiusSlider,
+                       [=](int value, float scale) -> EditorWorker::Operation {
+                           if (gaussianSizeSlider->value() % 2 == 0)
+                               return nullptr;
+                           return bindOperation(tifo::rgb_gaussian,
+                                                gaussianSizeSlider->value(),
+                                                value * scale);
+                       }, 4);
+
         filtersCheckBoxLayout->addLayout(gaussianFilterLayout);
 
         // SOBEL
@@ -394,24 +1932,26 @@ public:
 
         sobelFilterLayout->addLayout(sobelSpaceLayout);
 
+        // The 5x5 blur ahead of the gradient reads 2 pixels away, the
+        // gradient one more
         QPushButton* sobelFilterButton =
             new QPushButton("Apply sobel filter", this);
         connect(sobelFilterButton, &QPushButton::clicked, this, [=, this]() {
             if (sobelRGBCheckBox->isChecked())
             {
-                applyFilter(tifo::sobel_rgb, "Sobel RGB");
+                applyStencil(3, tifo::sobel_rgb, "Sobel RGB");
             }
             else if (sobelHSVCheckBox->isChecked())
             {
-                applyFilter(tifo::sobel_hsv, "Sobel HSV");
+                applyStencil(3, tifo::sobel_hsv, "Sobel HSV");
             }
             else if (sobelYCrCbCheckBox->isChecked())
             {
-                applyFilter(tifo::sobel_yCrCb, "Sobel YCrCb");
+                applyStencil(3, tifo::sobel_yCrCb, "Sobel YCrCb");
             }
             else
             {
-                applyFilter(tifo::sobel_gray, "Sobel GRAY");
+                applyStencil(3, tifo::sobel_gray, "Sobel GRAY");
             }
         });
         sobelFilterButton->setEnabled(false);
@@ -432,6 +1972,17 @@ public:
         connect(sobelYCrCbCheckBox, &QCheckBox::clicked, this, lambdaFuncSobel);
         connect(sobelGrayCheckBox, &QCheckBox::clicked, this, lambdaFuncSobel);
 
+        // Thin edges of the gray level; the blur, gradient and suppression
+        // read up to 7 pixels away
+        QPushButton* cannyButton = new QPushButton("Apply canny edges", this);
+        connect(cannyButton, &QPushButton::clicked, this, [this]() {
+            // The overload freeing its workspace once applied
+            void (*canny)(tifo::rgb24_image&, float, int, int) =
+                tifo::canny_gray;
+            applyStencil(7, canny, "Canny", 1.4f, 40, 100);
+        });
+        sobelFilterLayout->addWidget(cannyButton);
+
         filtersCheckBoxLayout->addLayout(sobelFilterLayout);
 
         // LAPLACIAN
@@ -496,33 +2047,33 @@ public:
 
         laplacianFilterLayout->addLayout(laplacianSpaceLayout);
 
+        // Same halo as the sobel filter, after the same blur
         QPushButton* laplacianFilterButton =
             new QPushButton("Apply laplacian filter", this);
         connect(laplacianFilterButton, &QPushButton::clicked, this,
                 [=, this]() {
                     if (laplacianRGBCheckBox->isChecked())
                     {
-                        applyFilterFloat(tifo::laplacien_filter_rgb,
-                                         (float)laplacianK_value / 100,
-                                         "Laplacian RGB");
+                        applyStencil(3, tifo::laplacien_filter_rgb,
+                                     "Laplacian RGB",
+                                     (float)laplacianK_value / 100);
                     }
                     else if (laplacianHSVCheckBox->isChecked())
                     {
-                        applyFilterFloat(tifo::laplacien_filter_hsv,
-                                         (float)laplacianK_value / 100,
-                                         "Laplacian");
+                        applyStencil(3, tifo::laplacien_filter_hsv,
+                                     "Laplacian",
+                                     (float)laplacianK_value / 100);
                     }
                     else if (laplacianYCrCbCheckBox->isChecked())
                     {
-                        applyFilterFloat(tifo::laplacien_filter_yCrCb,
-                                         (float)laplacianK_value / 100,
-                                         "Laplacian");
+                        applyStencil(3, tifo::laplacien_filter_yCrCb,
+                                     "Laplacian",
+                                     (float)laplacianK_value / 100);
                     }
                     else
                     {
-                        applyFilterFloat(tifo::laplacian_gray,
-                                         (float)laplacianK_value / 100,
-                                         "Laplacian");
+                        applyStencil(3, tifo::laplacian_gray, "Laplacian",
+                                     (float)laplacianK_value / 100);
                     }
                 });
         laplacianFilterButton->setEnabled(false);
@@ -544,79 +2095,55 @@ public:
                 lambdaFuncLaplacian);
         connect(laplacianYCrCbCheckBox, &QCheckBox::clicked, this,
                 lambdaFuncLaplacian);
-        connect(laplacianGrayCheckBox, &QCheckBox::clicked, this,
-                lambdaFuncLaplacian);
-
-        filtersCheckBoxLayout->addLayout(laplacianFilterLayout);
-
-        // HIDE / SHOW
-        connect(toggleFiltersButton, &QPushButton::clicked, [=]() {
-            bool isVisible = FiltersGroup->isVisible();
-            FiltersGroup->setVisible(!isVisible);
-            if (isVisible)
-            {
-                toggleFiltersButton->setText("> Filters");
-            }
-            else
-            {
-                toggleFiltersButton->setText("V Filters");
-            }
-        });
-
-        /**
-         ** FLIP
-         **/
+        connect(laplacianGrayCheckBox, &QCheckBox::clicked, this,
+                lambdaFuncLaplacian);
 
-        QPushButton* toggleFlipButton = new QPushButton("> Flip");
-        optionsLayout->addWidget(toggleFlipButton);
+        connectPreview(laplacianKSlider,
+                       [=](int value, float) -> EditorWorker::Operation {
+                           float k = value / 100.0f;
+                           if (!laplacianFilterButton->isEnabled())
+                               return nullptr;
+                           if (laplacianRGBCheckBox->isChecked())
+                               return bindOperation(tifo::laplacien_filter_rgb,
+                                                    k);
+                           if (laplacianHSVCheckBox->isChecked())
+                               return bindOperation(tifo::laplacien_filter_hsv,
+                                                    k);
+                           if (laplacianYCrCbCheckBox->isChecked())
+                               return bindOperation(
+                                   tifo::laplacien_filter_yCrCb, k);
+                           return bindOperation(tifo::laplacian_gray, k);
+                       }, 3);
 
-        QGroupBox* flipBox = new QGroupBox;
-        flipBox->setVisible(false);
-        flipBox->setMaximumHeight(100);
+        filtersCheckBoxLayout->addLayout(laplacianFilterLayout);
+    }
 
+    void buildFlipPanel(QGroupBox* group)
+    {
         QVBoxLayout* flipLayout = new QVBoxLayout;
 
         QPushButton* horizontalFilterButton =
             new QPushButton("Horizontal Flip", this);
         connect(horizontalFilterButton, &QPushButton::clicked, this, [this]() {
-            applyFilter(tifo::horizontal_flip, "Horizontal Flip");
+            auto flip = bindOperation(tifo::horizontal_flip);
+            submitOperation("Horizontal Flip", flip, nullptr, flip,
+                            wholeImage);
         });
         flipLayout->addWidget(horizontalFilterButton);
 
         QPushButton* verticalFilterButton =
             new QPushButton("Vertical Flip", this);
         connect(verticalFilterButton, &QPushButton::clicked, this, [this]() {
-            applyFilter(tifo::vertical_flip, "Vertical Flip");
+            auto flip = bindOperation(tifo::vertical_flip);
+            submitOperation("Vertical Flip", flip, nullptr, flip, wholeImage);
         });
         flipLayout->addWidget(verticalFilterButton);
 
-        flipBox->setLayout(flipLayout);
-        optionsLayout->addWidget(flipBox);
-
-        connect(toggleFlipButton, &QPushButton::clicked, [=]() {
-            bool isVisible = flipBox->isVisible();
-            flipBox->setVisible(!isVisible);
-            if (isVisible)
-            {
-                toggleFlipButton->setText("> Flip");
-            }
-            else
-            {
-                toggleFlipButton->setText("V Flip");
-            }
-        });
-
-        /**
-         ** ROTATE PART
-         **/
-
-        QPushButton* toggleRotateButton = new QPushButton("> Rotate");
-        optionsLayout->addWidget(toggleRotateButton);
-
-        QGroupBox* rotateBox = new QGroupBox;
-        rotateBox->setVisible(false);
-        rotateBox->setMaximumHeight(200);
+        group->setLayout(flipLayout);
+    }
 
+    void buildRotatePanel(QGroupBox* group)
+    {
         QVBoxLayout* rotateLayout = new QVBoxLayout;
 
         QHBoxLayout* rotateSliderLayout = new QHBoxLayout;
@@ -651,41 +2178,23 @@ public:
 
         QPushButton* rotateButton = new QPushButton("Rotate", this);
         connect(rotateButton, &QPushButton::clicked, this, [this]() {
-            applyRotate(tifo::rotate_image, rotate_value, "Rotate");
+            submitOperation("Rotate",
+                            bindOperation(tifo::rotate_image, rotate_value),
+                            nullptr, nullptr, wholeImage);
         });
         rotateLayout->addWidget(rotateButton);
 
-        rotateBox->setLayout(rotateLayout);
-        optionsLayout->addWidget(rotateBox);
-
-        connect(toggleRotateButton, &QPushButton::clicked, [=]() {
-            bool isVisible = rotateBox->isVisible();
-            rotateBox->setVisible(!isVisible);
-            if (isVisible)
-            {
-                toggleRotateButton->setText("> Rotate");
-            }
-            else
-            {
-                toggleRotateButton->setText("V Rotate");
-            }
+        connectPreview(rotateSlider, [=](int value, float) {
+            return bindOperation(tifo::rotate_image, value);
         });
 
-        /**
-         ** SWAP CHANNELS PART
-         **/
-
-        QPushButton* toggleChangeChannelsButton = new QPushButton("> RGB Swap");
-        optionsLayout->addWidget(toggleChangeChannelsButton);
-
-        QGroupBox* SwapChannelsGroup = new QGroupBox();
-        SwapChannelsGroup->setMaximumHeight(100);
-        SwapChannelsGroup->setCheckable(false); // Not checkable
-        SwapChannelsGroup->setVisible(false); // Initially not visible
-        optionsLayout->addWidget(SwapChannelsGroup);
+        group->setLayout(rotateLayout);
+    }
 
+    void buildSwapChannelsPanel(QGroupBox* group)
+    {
         QVBoxLayout* SwapChannelLayout = new QVBoxLayout;
-        SwapChannelsGroup->setLayout(SwapChannelLayout);
+        group->setLayout(SwapChannelLayout);
 
         QHBoxLayout* SwapChannelsCheckBoxLayout = new QHBoxLayout;
         SwapChannelLayout->addLayout(SwapChannelsCheckBoxLayout);
@@ -739,41 +2248,17 @@ public:
                         channel1 = GREEN;
                         channel2 = BLUE;
                     }
-                    MainWindow::applySwap(tifo::swap_channels, channel1,
-                                          channel2, "Swap");
+                    applyInvolution(tifo::swap_channels, "Swap", channel1,
+                                    channel2);
                 });
+    }
 
-        connect(toggleChangeChannelsButton, &QPushButton::clicked, [=]() {
-            bool isVisible = SwapChannelsGroup->isVisible();
-            SwapChannelsGroup->setVisible(!isVisible);
-            if (isVisible)
-            {
-                toggleChangeChannelsButton->setText("> RGB Swap");
-            }
-            else
-            {
-                toggleChangeChannelsButton->setText("V RGB Swap");
-            }
-        });
-
-        /**
-         ** RGB INCREASING
-         **/
-
-        QPushButton* toggleChannelsButton = new QPushButton("> RGB");
-        optionsLayout->addWidget(toggleChannelsButton);
-
-        QGroupBox* channelsGroup = new QGroupBox();
-        channelsGroup->setMaximumHeight(400);
-        channelsGroup->setCheckable(false); // Not checkable
-        channelsGroup->setVisible(false); // Initially not visible
-        optionsLayout->addWidget(channelsGroup);
-
+    void buildChannelsPanel(QGroupBox* group)
+    {
         QVBoxLayout* checkBoxChannelLayout = new QVBoxLayout;
-        channelsGroup->setLayout(checkBoxChannelLayout);
+        group->setLayout(checkBoxChannelLayout);
 
         // SLIDER 1: RED
-        red_value = 0;
 
         QVBoxLayout* redLayout = new QVBoxLayout;
 
@@ -805,16 +2290,21 @@ public:
         connect(redButton, &QPushButton::clicked, this, [=, this]() {
             auto old_value = red_value;
             auto current_value = redSlider->value();
-            applySwap(tifo::increase_channel, current_value - old_value, RED,
-                      "Red");
-            red_value = current_value;
+            submitOperation("Red",
+                            bindOperation(tifo::increase_channel,
+                                          current_value - old_value, RED),
+                            [=, this]() { red_value = current_value; });
         });
         redLayout->addWidget(redButton);
 
+        connectPreview(redSlider, [=, this](int value, float) {
+            return bindOperation(tifo::increase_channel,
+                                 value - red_value, RED);
+        }, 0);
+
         checkBoxChannelLayout->addLayout(redLayout);
 
         // SLIDER 2: GREEN
-        green_value = 0;
 
         QVBoxLayout* greenLayout = new QVBoxLayout;
 
@@ -846,16 +2336,21 @@ public:
         connect(greenButton, &QPushButton::clicked, this, [=, this]() {
             auto old_value = green_value;
             auto current_value = greenSlider->value();
-            applySwap(tifo::increase_channel, current_value - old_value, GREEN,
-                      "Green");
-            green_value = current_value;
+            submitOperation("Green",
+                            bindOperation(tifo::increase_channel,
+                                          current_value - old_value, GREEN),
+                            [=, this]() { green_value = current_value; });
         });
         greenLayout->addWidget(greenButton);
 
+        connectPreview(greenSlider, [=, this](int value, float) {
+            return bindOperation(tifo::increase_channel,
+                                 value - green_value, GREEN);
+        }, 0);
+
         checkBoxChannelLayout->addLayout(greenLayout);
 
         // SLIDER 3: BLUE
-        blue_value = 0;
 
         QVBoxLayout* blueLayout = new QVBoxLayout;
 
@@ -887,45 +2382,27 @@ public:
         connect(blueButton, &QPushButton::clicked, this, [=, this]() {
             auto old_value = blue_value;
             auto current_value = blueSlider->value();
-            applySwap(tifo::increase_channel, current_value - old_value, BLUE,
-                      "Blue");
-            blue_value = current_value;
+            submitOperation("Blue",
+                            bindOperation(tifo::increase_channel,
+                                          current_value - old_value, BLUE),
+                            [=, this]() { blue_value = current_value; });
         });
         blueLayout->addWidget(blueButton);
 
-        checkBoxChannelLayout->addLayout(blueLayout);
-
-        connect(toggleChannelsButton, &QPushButton::clicked, [=]() {
-            bool isVisible = channelsGroup->isVisible();
-            channelsGroup->setVisible(!isVisible);
-            if (isVisible)
-            {
-                toggleChannelsButton->setText("> RGB");
-            }
-            else
-            {
-                toggleChannelsButton->setText("V RGB");
-            }
-        });
-
-        /**
-         ** HSV INCREASING
-         **/
-
-        QPushButton* toggleHSVButton = new QPushButton("> HSV");
-        optionsLayout->addWidget(toggleHSVButton);
+        connectPreview(blueSlider, [=, this](int value, float) {
+            return bindOperation(tifo::increase_channel,
+                                 value - blue_value, BLUE);
+        }, 0);
 
-        QGroupBox* HSVGroup = new QGroupBox();
-        HSVGroup->setMaximumHeight(400);
-        HSVGroup->setCheckable(false); // Not checkable
-        HSVGroup->setVisible(false); // Initially not visible
-        optionsLayout->addWidget(HSVGroup);
+        checkBoxChannelLayout->addLayout(blueLayout);
+    }
 
+    void buildHSVPanel(QGroupBox* group)
+    {
         QVBoxLayout* checkBoxHSVLayout = new QVBoxLayout;
-        HSVGroup->setLayout(checkBoxHSVLayout);
+        group->setLayout(checkBoxHSVLayout);
 
         // SLIDER 1: HUE
-        hue_value = 0;
 
         QVBoxLayout* hueLayout = new QVBoxLayout;
 
@@ -957,15 +2434,21 @@ public:
         connect(hueButton, &QPushButton::clicked, this, [=, this]() {
             auto old_value = hue_value;
             auto current_value = hueSlider->value();
-            applySlider(tifo::rgb_hue, current_value - old_value, "Hue");
-            hue_value = current_value;
+            submitOperation("Hue",
+                            bindOperation(tifo::rgb_hue,
+                                          current_value - old_value),
+                            [=, this]() { hue_value = current_value; });
         });
         hueLayout->addWidget(hueButton);
 
+        connectPreview(hueSlider, [=, this](int value, float) {
+            return bindOperation(tifo::rgb_hue,
+                                 value - hue_value);
+        }, 0);
+
         checkBoxHSVLayout->addLayout(hueLayout);
 
         // SLIDER 2: SATURATION
-        saturation_value = 0;
 
         QVBoxLayout* saturationLayout = new QVBoxLayout;
 
@@ -999,16 +2482,21 @@ public:
         connect(saturationButton, &QPushButton::clicked, this, [=, this]() {
             auto old_value = saturation_value;
             auto current_value = saturationSlider->value();
-            applySlider(tifo::rgb_saturation, current_value - old_value,
-                        "Saturation");
-            saturation_value = current_value;
+            submitOperation("Saturation",
+                            bindOperation(tifo::rgb_saturation,
+                                          current_value - old_value),
+                            [=, this]() { saturation_value = current_value; });
         });
         saturationLayout->addWidget(saturationButton);
 
+        connectPreview(saturationSlider, [=, this](int value, float) {
+            return bindOperation(tifo::rgb_saturation,
+                                 value - saturation_value);
+        }, 0);
+
         checkBoxHSVLayout->addLayout(saturationLayout);
 
         // SLIDER 3: VALUE
-        value_value = 0;
 
         QVBoxLayout* valueLayout = new QVBoxLayout;
 
@@ -1040,44 +2528,27 @@ public:
         connect(valueButton, &QPushButton::clicked, this, [=, this]() {
             auto old_value = value_value;
             auto current_value = valueSlider->value();
-            applySlider(tifo::rgb_value, current_value - old_value, "Value");
-            value_value = current_value;
+            submitOperation("Value",
+                            bindOperation(tifo::rgb_value,
+                                          current_value - old_value),
+                            [=, this]() { value_value = current_value; });
         });
         valueLayout->addWidget(valueButton);
 
-        checkBoxHSVLayout->addLayout(valueLayout);
-
-        connect(toggleHSVButton, &QPushButton::clicked, [=]() {
-            bool isVisible = HSVGroup->isVisible();
-            HSVGroup->setVisible(!isVisible);
-            if (isVisible)
-            {
-                toggleHSVButton->setText("> HSV");
-            }
-            else
-            {
-                toggleHSVButton->setText("V HSV");
-            }
-        });
-
-        /**
-         ** YCrCb INCREASING
-         **/
-
-        QPushButton* toggleYCbCrButton = new QPushButton("> YCrCb");
-        optionsLayout->addWidget(toggleYCbCrButton);
+        connectPreview(valueSlider, [=, this](int value, float) {
+            return bindOperation(tifo::rgb_value,
+                                 value - value_value);
+        }, 0);
 
-        QGroupBox* YCbCrGroup = new QGroupBox();
-        YCbCrGroup->setMaximumHeight(400);
-        YCbCrGroup->setCheckable(false); // Not checkable
-        YCbCrGroup->setVisible(false); // Initially not visible
-        optionsLayout->addWidget(YCbCrGroup);
+        checkBoxHSVLayout->addLayout(valueLayout);
+    }
 
+    void buildYCrCbPanel(QGroupBox* group)
+    {
         QVBoxLayout* checkBoxYCbCrLayout = new QVBoxLayout;
-        YCbCrGroup->setLayout(checkBoxYCbCrLayout);
+        group->setLayout(checkBoxYCbCrLayout);
 
         // SLIDER 1: Y
-        y_value = 0;
 
         QVBoxLayout* yLayout = new QVBoxLayout;
 
@@ -1109,16 +2580,21 @@ public:
         connect(yButton, &QPushButton::clicked, this, [=, this]() {
             auto old_value = y_value;
             auto current_value = ySlider->value();
-            applySwap(tifo::yCrCb_increase_channel, current_value - old_value,
-                      RED, "Y");
-            y_value = current_value;
+            submitOperation("Y",
+                            bindOperation(tifo::yCrCb_increase_channel,
+                                          current_value - old_value, RED),
+                            [=, this]() { y_value = current_value; });
         });
         yLayout->addWidget(yButton);
 
+        connectPreview(ySlider, [=, this](int value, float) {
+            return bindOperation(tifo::yCrCb_increase_channel,
+                                 value - y_value, RED);
+        }, 0);
+
         checkBoxYCbCrLayout->addLayout(yLayout);
 
         // SLIDER 2: GREEN
-        cr_value = 0;
 
         QVBoxLayout* crLayout = new QVBoxLayout;
 
@@ -1150,16 +2626,21 @@ public:
         connect(crButton, &QPushButton::clicked, this, [=, this]() {
             auto old_value = cr_value;
             auto current_value = crSlider->value();
-            applySwap(tifo::yCrCb_increase_channel, current_value - old_value,
-                      GREEN, "Cr");
-            cr_value = current_value;
+            submitOperation("Cr",
+                            bindOperation(tifo::yCrCb_increase_channel,
+                                          current_value - old_value, GREEN),
+                            [=, this]() { cr_value = current_value; });
         });
         crLayout->addWidget(crButton);
 
+        connectPreview(crSlider, [=, this](int value, float) {
+            return bindOperation(tifo::yCrCb_increase_channel,
+                                 value - cr_value, GREEN);
+        }, 0);
+
         checkBoxYCbCrLayout->addLayout(crLayout);
 
         // SLIDER 3: BLUE
-        cb_value = 0;
 
         QVBoxLayout* cbLayout = new QVBoxLayout;
 
@@ -1191,45 +2672,27 @@ public:
         connect(cbButton, &QPushButton::clicked, this, [=, this]() {
             auto old_value = cb_value;
             auto current_value = cbSlider->value();
-            applySwap(tifo::yCrCb_increase_channel, current_value - old_value,
-                      BLUE, "Cb");
-            cb_value = current_value;
+            submitOperation("Cb",
+                            bindOperation(tifo::yCrCb_increase_channel,
+                                          current_value - old_value, BLUE),
+                            [=, this]() { cb_value = current_value; });
         });
         cbLayout->addWidget(cbButton);
 
-        checkBoxYCbCrLayout->addLayout(cbLayout);
-
-        connect(toggleYCbCrButton, &QPushButton::clicked, [=]() {
-            bool isVisible = YCbCrGroup->isVisible();
-            YCbCrGroup->setVisible(!isVisible);
-            if (isVisible)
-            {
-                toggleYCbCrButton->setText("> YCrCb");
-            }
-            else
-            {
-                toggleYCbCrButton->setText("V YCrCb");
-            }
-        });
-
-        /**
-         ** PROCESSING OPTIONS PART
-         **/
-
-        QPushButton* toggleOptionsButton = new QPushButton("> Options");
-        optionsLayout->addWidget(toggleOptionsButton);
+        connectPreview(cbSlider, [=, this](int value, float) {
+            return bindOperation(tifo::yCrCb_increase_channel,
+                                 value - cb_value, BLUE);
+        }, 0);
 
-        QGroupBox* optionsGroup = new QGroupBox();
-        optionsGroup->setMaximumHeight(500);
-        optionsGroup->setCheckable(false); // Not checkable
-        optionsGroup->setVisible(false); // Initially not visible
-        optionsLayout->addWidget(optionsGroup);
+        checkBoxYCbCrLayout->addLayout(cbLayout);
+    }
 
+    void buildOptionsPanel(QGroupBox* group)
+    {
         QVBoxLayout* checkBoxLayout = new QVBoxLayout;
-        optionsGroup->setLayout(checkBoxLayout);
+        group->setLayout(checkBoxLayout);
 
         // SLIDER 1: CONTRAST
-        contrast_value = 100;
 
         QVBoxLayout* contrastLayout = new QVBoxLayout;
 
@@ -1263,16 +2726,21 @@ public:
         connect(contrastButton, &QPushButton::clicked, this, [=, this]() {
             auto old_value = std::max(contrast_value, 1);
             auto current_value = contrastSlider->value();
-            applySlider(tifo::increase_contrast,
-                        (int)((current_value * 100) / old_value), "Contrast");
-            contrast_value = current_value;
+            submitOperation("Contrast",
+                            bindOperation(tifo::increase_contrast,
+                                          (current_value * 100) / old_value),
+                            [=, this]() { contrast_value = current_value; });
         });
         contrastLayout->addWidget(contrastButton);
 
+        connectPreview(contrastSlider, [=, this](int value, float) {
+            return bindOperation(tifo::increase_contrast,
+                                 (value * 100) / std::max(contrast_value, 1));
+        }, 0);
+
         checkBoxLayout->addLayout(contrastLayout);
 
         // SLIDER 2: BLACK POINT
-        blackPoint_value = 0;
 
         QVBoxLayout* blackPointLayout = new QVBoxLayout;
 
@@ -1306,17 +2774,22 @@ public:
         connect(blackPointButton, &QPushButton::clicked, this, [=, this]() {
             auto old_value = blackPoint_value;
             auto current_value = blackPointSlider->value();
-            applySlider(tifo::adjust_black_point, current_value - old_value,
-                        "BlackPoint");
-            blackPoint_value = current_value;
+            submitOperation("BlackPoint",
+                            bindOperation(tifo::adjust_black_point,
+                                          current_value - old_value),
+                            [=, this]() { blackPoint_value = current_value; });
         });
         blackPointLayout->addWidget(blackPointButton);
 
+        connectPreview(blackPointSlider, [=, this](int value, float) {
+            return bindOperation(tifo::adjust_black_point,
+                                 value - blackPoint_value);
+        }, 0);
+
         checkBoxLayout->addLayout(blackPointLayout);
 
         // SLIDER 3: VIGNETTE
 
-        vignette_value = 0;
 
         QVBoxLayout* vignetteLayout = new QVBoxLayout;
 
@@ -1350,17 +2823,23 @@ public:
         connect(vignetteButton, &QPushButton::clicked, this, [=, this]() {
             auto old_value = vignette_value;
             auto current_value = vignetteSlider->value();
-            applySlider(tifo::add_vignette, current_value - old_value,
-                        "Vignette");
-            vignette_value = current_value;
+            submitOperation("Vignette",
+                            bindOperation(tifo::add_vignette,
+                                          current_value - old_value),
+                            [=, this]() { vignette_value = current_value; },
+                            nullptr, wholeImage);
         });
         vignetteLayout->addWidget(vignetteButton);
 
+        connectPreview(vignetteSlider, [=, this](int value, float) {
+            return bindOperation(tifo::add_vignette,
+                                 value - vignette_value);
+        });
+
         checkBoxLayout->addLayout(vignetteLayout);
 
         // SLIDER 4: GRAIN
 
-        grain_value = 0;
 
         QVBoxLayout* grainLayout = new QVBoxLayout;
 
@@ -1391,362 +2870,553 @@ public:
         QPushButton* grainButton = new QPushButton("Apply grain changes", this);
         connect(grainButton, &QPushButton::clicked, this, [=, this]() {
             auto current_value = grainSlider->value();
-            applySlider(tifo::apply_argentique_grain, current_value, "Grain");
-            grain_value = current_value;
+            submitOperation("Grain",
+                            bindOperation(tifo::apply_argentique_grain,
+                                          current_value),
+                            [=, this]() { grain_value = current_value; },
+                            nullptr, wholeImage);
         });
         grainLayout->addWidget(grainButton);
 
-        checkBoxLayout->addLayout(grainLayout);
-
-        // SHOW OPTIONS
-        connect(toggleOptionsButton, &QPushButton::clicked, [=]() {
-            bool isVisible = optionsGroup->isVisible();
-            optionsGroup->setVisible(!isVisible);
-            if (isVisible)
-            {
-                toggleOptionsButton->setText("> Other");
-            }
-            else
-            {
-                toggleOptionsButton->setText("V Other");
-            }
+        connectPreview(grainSlider, [=](int value, float) {
+            return bindOperation(tifo::apply_argentique_grain, value);
         });
+
+        checkBoxLayout->addLayout(grainLayout);
     }
 
-    void mousePressEvent(QMouseEvent* event)
+    /**
+     * Builds the operation previewed for the given slider value on a proxy
+     * of the given scale.
+     */
+    using PreviewFactory =
+        std::function<EditorWorker::Operation(int value, float scale)>;
+
+    /**
+     * Previews the slider's operation on a display sized proxy of the
+     * current state while it is dragged, then at full resolution once it is
+     * released. The history is left alone: the apply buttons still commit.
+     * The factory runs on the GUI thread and may return nullptr when the
+     * current settings cannot be previewed.
+     *
+     * An operation only reading the pixels up to halo pixels away from the
+     * ones it computes is previewed on the visible region alone when zoomed
+     * in; -1 means it depends on the whole image.
+     */
+    void connectPreview(QSlider* slider, PreviewFactory factory,
+                        int halo = -1)
     {
-        if (event->button() == Qt::LeftButton)
-        {
-            QPoint pos = event->pos();
-            qDebug() << "Mouse clicked at position" << pos;
-        }
+        previewHalos[slider] = halo;
 
-        QWidget::mousePressEvent(event);
-    }
+        connect(slider, &QSlider::valueChanged, this, [=, this](int value) {
+            if (!slider->isSliderDown())
+                return;
 
-public slots:
-    void loadImage()
-    {
-        QString fileName = QFileDialog::getOpenFileName(
-            this, "Open Image", "", "Image Files (*.png *.jpg *.bmp *.tga)");
-        if (!fileName.isEmpty())
-        {
-            m_image.load(fileName);
-            QPixmap pixmap = QPixmap::fromImage(m_image);
-            m_imageLabel->setPixmap(pixmap);
-            index = 0;
-            images = std::vector<QImage>(1);
-            images[0] = m_image;
-            saveButton->setEnabled(true);
-            backwardButton->setEnabled(true);
-            forwardButton->setEnabled(true);
-            originalButton->setEnabled(true);
-            optionsWidget->setEnabled(true);
-        }
-    }
+            if (slider == dragSlider && value != dragValue)
+                dragDirection = value > dragValue ? 1 : -1;
+            dragSlider = slider;
+            dragFactory = factory;
+            dragValue = value;
 
-    void saveImage()
-    {
-        QString fileName = QFileDialog::getSaveFileName(
-            this, "Save Image", "",
-            "PNG (*.png);;JPEG (*.jpg *.jpeg);;BMP (*.bmp)");
-        if (!fileName.isEmpty())
-        {
-            m_image.save(fileName);
-        }
+            requestPreview(slider, factory, value, false);
+        });
+        connect(slider, &QSlider::sliderReleased, this, [=, this]() {
+            requestPreview(slider, factory, slider->value(), true);
+        });
     }
 
-    void backwardImage()
+    void requestPreview(QSlider* slider, PreviewFactory factory, int value,
+                        bool fullResolution)
     {
-        qDebug() << index;
+        if (history.empty() || !history.contains(index))
+            return;
 
-        if (index > 0 && index <= images.size() - 1)
-        {
-            index--;
+        // Real requests always preempt the speculative ones
+        cancelSpeculation();
 
-            qDebug() << index;
+        if (!fullResolution)
+        {
+            auto key = previewKeyFor(slider, value, previewLevel());
+            if (auto cached = previewCache.find(key))
+            {
+                // Older previews would overwrite this newer one
+                previewTimer->stop();
+                pendingPreview = nullptr;
+                previewWorker->cancelAll();
+                previewJob = 0;
 
-            m_image = images[index];
+                if (latestJob == 0)
+                    showPreview(cached, key);
 
-            m_imageLabel->setPixmap(QPixmap::fromImage(m_image));
+                speculate();
+                return;
+            }
         }
-    }
 
-    void forwardImage()
-    {
-        qDebug() << index;
+        pendingPreview = std::move(factory);
+        pendingSlider = slider;
+        pendingValue = value;
+        pendingFullResolution = fullResolution;
 
-        if (index != images.size() - 1)
+        if (fullResolution)
         {
-            qDebug() << index;
-
-            index++;
-
-            m_image = images[index];
-
-            m_imageLabel->setPixmap(QPixmap::fromImage(m_image));
+            previewTimer->stop();
+            runPreview();
+        }
+        else if (!previewTimer->isActive())
+        {
+            previewTimer->start();
         }
     }
 
-    void originalImage()
+    /**
+     * While nothing else runs and the dragged slider still has the focus,
+     * renders its next values in the drag direction on the speculative
+     * worker, one at a time, so that small steps are shown from the cache.
+     */
+    void speculate()
     {
-        index = 0;
+        if (!dragSlider || history.empty() || !history.contains(index)
+            || latestJob != 0 || previewJob != 0 || pendingPreview
+            || speculativeJob != 0)
+            return;
 
-        m_image = images[index];
+        if (!dragSlider->hasFocus() && !dragSlider->isSliderDown())
+            return;
 
-        m_imageLabel->setPixmap(QPixmap::fromImage(m_image));
-
-        images = std::vector<QImage>(1);
-
-        images[0] = m_image;
+        int level = previewLevel();
+        for (int step = 1; step <= speculativeSteps; step++)
+        {
+            int value =
+                dragValue + step * dragDirection * dragSlider->singleStep();
+            if (value < dragSlider->minimum() || value > dragSlider->maximum())
+                return;
+
+            auto key = previewKeyFor(dragSlider, value, level);
+            if (previewCache.contains(key))
+                continue;
+
+            auto operation = dragFactory(value, 1.0f / (1 << level));
+            if (!operation)
+                return;
+
+            speculativeKey = std::move(key);
+            speculativeJob =
+                submitPreview(speculativeWorker, speculativeKey, operation);
+            return;
+        }
     }
 
-    void
-    applySlider(const std::function<void(tifo::rgb24_image&, int)>& processing,
-                int arg, const char* str)
+    void cancelSpeculation()
     {
-        qDebug() << arg;
+        speculativeWorker->cancelAll();
+        speculativeJob = 0;
+    }
 
-        QElapsedTimer timer1;
-        timer1.start();
-        auto tmp = qimage_to_rgb(images[index]);
-        QElapsedTimer timer2;
-        timer2.start();
+    /**
+     * Runs the operation on the pyramid level of the current state given by
+     * the key, or only on its region when it has one. The region is then
+     * processed with a margin of the slider's halo, cut off afterwards.
+     */
+    quint64 submitPreview(EditorWorker* target, const PreviewKey& key,
+                          EditorWorker::Operation operation)
+    {
+        auto proxies = currentProxies();
+        int level = key.level;
+        auto region = key.region;
+        int halo = previewHalo(static_cast<const QSlider*>(key.slider));
+        auto selection = halo != wholeImage ? this->selection : nullptr;
+
+        return target->submit(
+            history.get(index), [=](const tifo::rgb24_image&) {
+                auto proxy = proxies->level(level);
+                auto area = region.empty()
+                    ? tifo::image_rect{ 0, 0, proxy->sx, proxy->sy }
+                    : region.expanded(halo).intersected(
+                        { 0, 0, proxy->sx, proxy->sy });
+
+                // The selection is scaled to the level and moved to the area
+                auto process = [&](const tifo::rgb24_image& image) {
+                    if (!selection)
+                        return operation(image);
+                    return tifo::apply_in_selection(
+                        image,
+                        selection->at_level(level).translated(-area.x0,
+                                                               -area.y0),
+                        halo, operation);
+                };
+
+                if (region.empty())
+                    return process(*proxy);
+
+                std::unique_ptr<tifo::rgb24_image> input(
+                    tifo::crop(*proxy, area));
+                std::unique_ptr<tifo::rgb24_image> output(process(*input));
+                return tifo::crop(*output,
+                                  region.translated(-area.x0, -area.y0));
+            });
+    }
 
-        processing(*tmp, arg);
+    int previewLevel() const
+    {
+        return m_imageViewer->displayLevel();
+    }
 
-        m_image = rgb_to_qimage(*tmp);
+    /**
+     * Margin of pixels around a region the slider's operation reads, -1
+     * when it depends on the whole image.
+     */
+    int previewHalo(const QSlider* slider) const
+    {
+        auto halo = previewHalos.find(slider);
+        return halo == previewHalos.end() ? -1 : halo->second;
+    }
 
-        m_imageLabel->setPixmap(QPixmap::fromImage(m_image));
+    /**
+     * Visible part of a pyramid level, when zoomed in and the slider's
+     * operation can be previewed on it alone; empty otherwise.
+     */
+    tifo::image_rect previewRegion(const QSlider* slider, int level) const
+    {
+        if (!m_imageViewer->isZoomed() || previewHalo(slider) < 0)
+            return {};
 
-        qDebug() << str << " execution time: " << timer2.elapsed() << "ms";
+        return m_imageViewer->visibleRect().at_level(level);
+    }
 
-        index++;
+    /** Display proxies of the current state, rebuilt when it changes. */
+    std::shared_ptr<tifo::image_pyramid> currentProxies()
+    {
+        if (!proxies || proxiesState != history.id(index))
+            rebuildProxies(history.get(index));
+        return proxies;
+    }
 
-        if (images.size() == index)
-        {
-            images.push_back(m_image);
-        }
+    /** Reuses the levels of the previous state where the image is equal. */
+    void rebuildProxies(ConstImagePtr image)
+    {
+        if (proxies)
+            proxies = std::make_shared<tifo::image_pyramid>(std::move(image),
+                                                            *proxies);
         else
-        {
-            images[index] = m_image;
-        }
-
-        qDebug() << "Whole " << str
-                 << " process execution time: " << timer1.elapsed() << "ms";
+            proxies = std::make_shared<tifo::image_pyramid>(std::move(image));
+        proxiesState = history.id(index);
     }
 
-    void applyFilterFloat(
-        const std::function<void(tifo::rgb24_image&, float)>& processing,
-        float arg, const char* str)
+    PreviewKey previewKeyFor(const QSlider* slider, int value, int level) const
     {
-        qDebug() << arg;
-
-        QElapsedTimer timer1;
-        timer1.start();
-        auto tmp = qimage_to_rgb(images[index]);
-        QElapsedTimer timer2;
-        timer2.start();
-
-        processing(*tmp, arg);
-
-        m_image = rgb_to_qimage(*tmp);
-
-        m_imageLabel->setPixmap(QPixmap::fromImage(m_image));
-
-        qDebug() << str << " execution time: " << timer2.elapsed() << "ms";
-
-        index++;
-
-        if (images.size() == index)
+        PreviewKey key;
+        key.state = history.id(index);
+        key.slider = slider;
+        key.value = value;
+        key.level = level;
+        key.region = previewRegion(slider, level);
+
+        for (auto other : optionsWidget->findChildren<QSlider*>())
         {
-            images.push_back(m_image);
-        }
-        else
-        {
-            images[index] = m_image;
+            if (other != slider)
+                key.settings.push_back(other->value());
         }
+        for (auto box : optionsWidget->findChildren<QCheckBox*>())
+            key.settings.push_back(box->isChecked());
 
-        qDebug() << "Whole " << str
-                 << " process execution time: " << timer1.elapsed() << "ms";
+        return key;
     }
 
-    void applyFilter(const std::function<void(tifo::rgb24_image&)>& filter,
-                     const char* str)
+    /** What the scopes are computed on. */
+    struct ScopeSource
     {
-        QElapsedTimer timer1;
-        timer1.start();
-        auto tmp = qimage_to_rgb(images[index]);
-        QElapsedTimer timer2;
-        timer2.start();
-
-        filter(*tmp);
+        /** Image shown over the display, null for the state itself. */
+        ConstImagePtr preview;
+        std::shared_ptr<tifo::image_pyramid> proxies;
+        /** Level of the proxies the state is shown at. */
+        int level = 0;
+    };
+
+    /** Computes the scopes of the current state on its display level. */
+    void refreshScopes()
+    {
+        if (proxies)
+            requestScopes({ nullptr, proxies, previewLevel() });
+    }
 
-        m_image = rgb_to_qimage(*tmp);
+    /**
+     * Computes the scopes on the visible panel once the current job is
+     * done. Only the newest request is kept meanwhile, so that they follow
+     * a dragged slider at the rate of the previews at most.
+     */
+    void requestScopes(ScopeSource source)
+    {
+        if (!scopeView || !scopeView->isVisible())
+            return;
 
-        m_imageLabel->setPixmap(QPixmap::fromImage(m_image));
+        pendingScope = std::move(source);
+        if (scopeJob == 0)
+            runScope();
+    }
 
-        qDebug() << str << " filter execution time: " << timer2.elapsed()
-                 << "ms";
+    void runScope()
+    {
+        if (!pendingScope)
+            return;
+
+        auto source = std::move(*pendingScope);
+        pendingScope.reset();
+
+        bool waveform = waveformBox->isChecked();
+        auto image = source.preview ? source.preview : source.proxies->level(0);
+        scopeJob = scopeWorker->submit(
+            std::move(image), [=](const tifo::rgb24_image& preview) {
+                auto proxy = source.preview
+                    ? nullptr
+                    : source.proxies->level(source.level);
+                const auto& shown = proxy ? *proxy : preview;
+
+                std::unique_ptr<tifo::rgb24_image> histogram(
+                    tifo::histogram_scope(shown, scopeHeight));
+                if (!waveform)
+                    return histogram.release();
+
+                std::unique_ptr<tifo::rgb24_image> wave(tifo::waveform_scope(
+                    shown, tifo::scope_levels, scopeHeight));
+                auto scopes = new tifo::rgb24_image(tifo::scope_levels,
+                                                    2 * scopeHeight);
+                std::size_t bytes = tifo::scope_levels * scopeHeight * 3;
+                std::memcpy(scopes->pixels, histogram->pixels, bytes);
+                std::memcpy(scopes->pixels + bytes, wave->pixels, bytes);
+                return scopes;
+            });
+    }
 
-        index++;
+    /**
+     * Shows the current state, replaying the steps leading to it first when
+     * it is not stored.
+     */
+    void showState()
+    {
+        history.set_current(index);
+        refreshSteps();
 
-        if (images.size() == index)
-        {
-            images.push_back(m_image);
-        }
-        else
+        if (auto image = history.get(index))
         {
-            images[index] = m_image;
+            showImage(image);
+            updateMemoryUsage();
+            return;
         }
 
-        qDebug() << "Whole " << str
-                 << " process execution time: " << timer1.elapsed() << "ms";
+        auto replay = history.prepare_replay(index);
+        startJob("Replay", replay->source,
+                 [replay](const tifo::rgb24_image&) { return replay->run(); },
+                 [=, this](ImagePtr result, qint64 elapsed) {
+                     history.finish_replay(*replay, result);
+
+                     showImage(result);
+                     updateMemoryUsage();
+
+                     statusBar->showMessage(
+                         QString("%1 steps replayed in %2 ms")
+                             .arg(replay->steps.size())
+                             .arg(elapsed),
+                         5000);
+                 });
     }
 
-    void applyGaussian(
-        const std::function<void(tifo::rgb24_image&, int, float)>& filter,
-        int size, float radius, const char* str)
+    void toggleStep(int row, bool enabled)
     {
-        qDebug() << "radius = " << radius << ", size = " << size;
-        QElapsedTimer timer1;
-        timer1.start();
-        auto tmp = qimage_to_rgb(images[index]);
-        QElapsedTimer timer2;
-        timer2.start();
+        if (row < 0 || row >= (int)history.size() - 1)
+            return;
 
-        filter(*tmp, size, radius);
-
-        m_image = rgb_to_qimage(*tmp);
+        cancelPending();
+        history.set_enabled(row, enabled);
+        showState();
+    }
 
-        m_imageLabel->setPixmap(QPixmap::fromImage(m_image));
+    /** Lists the steps, the undone ones greyed out. */
+    void refreshSteps()
+    {
+        int steps = history.size() - 1;
 
-        qDebug() << str << " filter execution time: " << timer2.elapsed()
-                 << "ms";
+        stepsList->blockSignals(true);
 
-        index++;
+        while (stepsList->count() > steps)
+            delete stepsList->takeItem(stepsList->count() - 1);
 
-        if (images.size() == index)
-        {
-            images.push_back(m_image);
-        }
-        else
+        for (int i = 0; i < steps; i++)
         {
-            images[index] = m_image;
+            if (i == stepsList->count())
+                stepsList->addItem(new QListWidgetItem);
+
+            auto& step = history.step(i);
+            auto item = stepsList->item(i);
+            item->setText(QString("%1. %2").arg(i + 1).arg(
+                QString::fromStdString(step.name)));
+            item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+            item->setCheckState(step.enabled ? Qt::Checked : Qt::Unchecked);
+            item->setForeground(i < (int)index ? Qt::black : Qt::gray);
         }
 
-        qDebug() << "Whole " << str
-                 << " process execution time: " << timer1.elapsed() << "ms";
+        stepsList->blockSignals(false);
     }
 
-    void
-    applyGlow(const std::function<void(tifo::rgb24_image&, float, int)>& filter,
-              float radius, int threshold, const char* str)
+    void cancelPreview()
     {
-        qDebug() << "radius = " << radius << ", threshold = " << threshold;
-        QElapsedTimer timer1;
-        timer1.start();
-        auto tmp = qimage_to_rgb(images[index]);
-        QElapsedTimer timer2;
-        timer2.start();
-
-        filter(*tmp, radius, threshold);
-
-        m_image = rgb_to_qimage(*tmp);
-
-        m_imageLabel->setPixmap(QPixmap::fromImage(m_image));
-
-        qDebug() << str << " filter execution time: " << timer2.elapsed()
-                 << "ms";
+        previewTimer->stop();
+        pendingPreview = nullptr;
+        previewWorker->cancelAll();
+        previewJob = 0;
+        cancelSpeculation();
+    }
 
-        index++;
+    void cancelPending()
+    {
+        cancelPreview();
+        worker->cancelAll();
+        latestJob = 0;
+        progressBar->setVisible(false);
+        statusBar->clearMessage();
+    }
 
-        if (images.size() == index)
-        {
-            images.push_back(m_image);
-        }
-        else
+    /** Shows the image of the current state. */
+    void showImage(ConstImagePtr image)
+    {
+        // A selection does not follow the image through a change of size
+        if (selection && proxies
+            && (proxies->base().sx != image->sx
+                || proxies->base().sy != image->sy))
         {
-            images[index] = m_image;
+            setSelection({});
+            m_imageViewer->clearSelection();
         }
 
-        qDebug() << "Whole " << str
-                 << " process execution time: " << timer1.elapsed() << "ms";
+        if (!proxies || proxiesState != history.id(index)
+            || &proxies->base() != image.get())
+            rebuildProxies(std::move(image));
+        m_imageViewer->setPyramid(proxies);
+        refreshScopes();
     }
 
-    void
-    applySwap(const std::function<void(tifo::rgb24_image&, int, int)>& filter,
-              int channel1, int channel2, const char* str)
+    /**
+     * Shows a preview rendered for the key: full resolution ones are tiled
+     * like a state, the others drawn over the display.
+     */
+    void showPreview(ConstImagePtr image, const PreviewKey& key)
     {
-        QElapsedTimer timer1;
-        timer1.start();
-        auto tmp = qimage_to_rgb(images[index]);
-        QElapsedTimer timer2;
-        timer2.start();
-
-        filter(*tmp, channel1, channel2);
-
-        m_image = rgb_to_qimage(*tmp);
-
-        m_imageLabel->setPixmap(QPixmap::fromImage(m_image));
-
-        qDebug() << str << " filter execution time: " << timer2.elapsed()
-                 << "ms";
-
-        index++;
-
-        if (images.size() == index)
-        {
-            images.push_back(m_image);
-        }
+        if (key.level == 0 && key.region.empty())
+            m_imageViewer->setImage(image);
+        else if (key.region.empty())
+            m_imageViewer->setOverlay(*image, { 0, 0, image->sx, image->sy },
+                                      key.level);
         else
-        {
-            images[index] = m_image;
-        }
+            m_imageViewer->setOverlay(*image, key.region, key.level);
 
-        qDebug() << "Whole " << str
-                 << " process execution time: " << timer1.elapsed() << "ms";
+        requestScopes({ std::move(image), nullptr, 0 });
     }
 
-    void applyRotate(const std::function<tifo::rgb24_image*(tifo::rgb24_image&,
-                                                            int)>& processing,
-                     int arg, const char* str)
+    void updateMemoryUsage()
     {
-        qDebug() << arg;
-
-        QElapsedTimer timer1;
-        timer1.start();
-        auto tmp = qimage_to_rgb(images[index]);
-        QElapsedTimer timer2;
-        timer2.start();
-
-        auto new_image = processing(*tmp, arg);
-
-        m_image = rgb_to_qimage(*new_image);
-
-        m_imageLabel->setPixmap(QPixmap::fromImage(m_image));
-
-        qDebug() << str << " execution time: " << timer2.elapsed() << "ms";
-
-        index++;
-
-        if (images.size() == index)
-        {
-            images.push_back(m_image);
-        }
-        else
-        {
-            images[index] = m_image;
-        }
+        auto stats = history.stats();
+        const double mb = 1024.0 * 1024.0;
+
+        memoryLabel->setText(
+            QString("History: %1 states, %2 MB in memory, %3 MB on disk")
+                .arg(stats.states)
+                .arg((stats.resident_bytes + stats.compressed_bytes) / mb, 0,
+                     'f', 1)
+                .arg(stats.spilled_bytes / mb, 0, 'f', 1));
+        memoryLabel->setToolTip(
+            QString("%1 decoded (%2 MB), %3 compressed (%4 MB), %5 on disk "
+                    "(%6 MB), budget %7 MB")
+                .arg(stats.resident)
+                .arg(stats.resident_bytes / mb, 0, 'f', 1)
+                .arg(stats.compressed)
+                .arg(stats.compressed_bytes / mb, 0, 'f', 1)
+                .arg(stats.spilled)
+                .arg(stats.spilled_bytes / mb, 0, 'f', 1)
+                .arg(stats.budget_bytes / mb, 0, 'f', 0));
+    }
 
-        qDebug() << "Whole " << str
-                 << " process execution time: " << timer1.elapsed() << "ms";
+    /** TIFO_HISTORY_BUDGET_MB overrides the default 2 GB history budget. */
+    static std::size_t historyBudget()
+    {
+        std::size_t megabytes = 2048;
+        if (auto value = std::getenv("TIFO_HISTORY_BUDGET_MB"))
+            megabytes = std::strtoull(value, nullptr, 10);
+        return megabytes * 1024 * 1024;
     }
 
-private:
+    /** Buffer saved to disk, refreshed in place from the current state. */
     QImage m_image;
-    ResizableImageLabel* m_imageLabel;
-    std::vector<QImage> images;
+    ImageViewer* m_imageViewer;
+    /** Steps taking less than 250 ms to replay are not stored. */
+    tifo::edit_stack history{ historyBudget(), 250 };
+    std::shared_ptr<tifo::image_pyramid> proxies;
+    quint64 proxiesState = 0;
+
+    EditorWorker* worker;
+    /** Id of the newest submitted job, 0 when none is pending. */
+    quint64 latestJob = 0;
+    const char* jobName = "";
+    std::function<void(ImagePtr, qint64)> jobCompletion;
+    QElapsedTimer jobTimer;
+
+    EditorWorker* previewWorker;
+    QTimer* previewTimer;
+    PreviewFactory pendingPreview;
+    QSlider* pendingSlider = nullptr;
+    int pendingValue = 0;
+    bool pendingFullResolution = false;
+    /** Id of the preview being computed, 0 when none is. */
+    quint64 previewJob = 0;
+    PreviewKey previewKey;
+    bool previewIsProxy = false;
+
+    /** Number of values pre-rendered ahead of the dragged slider. */
+    static constexpr int speculativeSteps = 3;
+    EditorWorker* speculativeWorker;
+    quint64 speculativeJob = 0;
+    PreviewKey speculativeKey;
+    PreviewCache previewCache{ 16 };
+
+    /** Height of each scope, in pixels of its image. */
+    static constexpr int scopeHeight = 128;
+    EditorWorker* scopeWorker;
+    /** Id of the scopes being computed, 0 when none are. */
+    quint64 scopeJob = 0;
+    std::optional<ScopeSource> pendingScope;
+    /** Null until the scopes panel is first expanded. */
+    ScopeView* scopeView = nullptr;
+    QCheckBox* waveformBox = nullptr;
+
+    /** Halo of the operations applied to the whole image, selection or not. */
+    static constexpr int wholeImage = -1;
+    /** Pixels the operations are restricted to, null for all of them. */
+    std::shared_ptr<const tifo::selection> selection;
+
+    tifo::brush_effect brushEffect = tifo::brush_effect::dodge;
+    int brushRadius = 20;
+    int brushHardness = 50;
+    int brushAmount = 30;
+
+    /** Stroke being painted, rendered on a copy of a display level. */
+    std::optional<tifo::brush_stroke> stroke;
+    int strokeLevel = 0;
+    ConstImagePtr strokeSource;
+    std::shared_ptr<tifo::rgb24_image> strokeCanvas;
+    /** Part of the canvas painted so far. */
+    tifo::image_rect strokeRect;
+    std::map<const QSlider*, int> previewHalos;
+
+    QSlider* dragSlider = nullptr;
+    PreviewFactory dragFactory;
+    int dragValue = 0;
+    int dragDirection = 1;
+
+    QStatusBar* statusBar;
+    QProgressBar* progressBar;
+    QLabel* memoryLabel;
+    QListWidget* stepsList;
+    /** Step replaced by the next applied operation, -1 when none is. */
+    int editingStep = -1;
 
     SquareButton* saveButton;
     SquareButton* backwardButton;
@@ -1754,25 +3424,25 @@ private:
     SquareButton* originalButton;
     QWidget* optionsWidget;
 
-    int index;
+    size_t index;
 
-    int hue_value;
-    int saturation_value;
-    int value_value;
+    int hue_value = 0;
+    int saturation_value = 0;
+    int value_value = 0;
 
-    int y_value;
-    int cr_value;
-    int cb_value;
+    int y_value = 0;
+    int cr_value = 0;
+    int cb_value = 0;
 
-    int contrast_value;
-    int blackPoint_value;
+    int contrast_value = 100;
+    int blackPoint_value = 0;
 
-    int vignette_value;
-    int grain_value;
+    int vignette_value = 0;
+    int grain_value = 0;
 
-    int red_value;
-    int green_value;
-    int blue_value;
+    int red_value = 0;
+    int green_value = 0;
+    int blue_value = 0;
 
     int glowRadius_value;
     int glowThreshold_value;
@@ -0,0 +1,215 @@
+#include "median.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "scheduler.hh"
+
+namespace tifo
+{
+    namespace
+    {
+        // Levels per coarse bin of the two level histograms
+        constexpr int fine_bins = 16;
+        constexpr int coarse_bins = IMAGE_NB_LEVELS / fine_bins;
+
+        // Width of the strips a band is cut in, for the column histograms
+        // to stay in cache
+        constexpr int strip_width = 256;
+
+        // (2 * max_rank_radius + 1)^2 fits the counts of the window
+        typedef uint16_t bin;
+
+        struct histogram
+        {
+            bin coarse[coarse_bins];
+            bin fine[IMAGE_NB_LEVELS];
+        };
+
+        inline void count(histogram& hist, int level, int delta)
+        {
+            hist.coarse[level / fine_bins] += delta;
+            hist.fine[level] += delta;
+        }
+
+        inline void add_bins(bin* to, const bin* from, int n)
+        {
+            for (int i = 0; i < n; i++)
+                to[i] += from[i];
+        }
+
+        inline void remove_bins(bin* to, const bin* from, int n)
+        {
+            for (int i = 0; i < n; i++)
+                to[i] -= from[i];
+        }
+
+        /*
+         * Histogram of the window. Its coarse bins follow each move, but a
+         * group of fine bins is only brought up to date when the rank falls
+         * in it: from the columns entered and left since, or from the whole
+         * window when that is cheaper.
+         */
+        struct window_histogram
+        {
+            histogram hist;
+            /** Window position each group of fine bins is valid for. */
+            int position[coarse_bins];
+        };
+
+        template <typename Column>
+        void reset(window_histogram& window, int x, int radius,
+                   Column column)
+        {
+            std::memset(&window.hist, 0, sizeof(histogram));
+            for (int dx = -radius; dx <= radius; dx++)
+                add_bins(window.hist.coarse, column(x + dx).coarse,
+                         coarse_bins);
+            std::fill(window.position, window.position + coarse_bins,
+                      x - 2 * radius - 2);
+        }
+
+        // Level of the value of the given rank, from 0, in the window
+        // centered on x
+        template <typename Column>
+        int rank_level(window_histogram& window, int x, int radius,
+                       int rank, Column column)
+        {
+            int coarse = 0;
+            while (rank >= window.hist.coarse[coarse])
+                rank -= window.hist.coarse[coarse++];
+
+            bin* fine = window.hist.fine + coarse * fine_bins;
+            int& position = window.position[coarse];
+            if (2 * (x - position) > 2 * radius + 1)
+            {
+                std::memset(fine, 0, fine_bins * sizeof(bin));
+                for (int dx = -radius; dx <= radius; dx++)
+                    add_bins(fine, column(x + dx).fine + coarse * fine_bins,
+                             fine_bins);
+            }
+            else
+            {
+                for (int p = position + 1; p <= x; p++)
+                {
+                    remove_bins(fine,
+                                column(p - radius - 1).fine
+                                    + coarse * fine_bins,
+                                fine_bins);
+                    add_bins(fine, column(p + radius).fine + coarse * fine_bins,
+                             fine_bins);
+                }
+            }
+            position = x;
+
+            int level = 0;
+            while (rank >= fine[level])
+                rank -= fine[level++];
+
+            return coarse * fine_bins + level;
+        }
+
+        // Filters channel c of the pixels of [x0, x1) x [y0, y1)
+        void filter_block(const rgb24_image& source, rgb24_image& target,
+                          int c, int radius, int rank, int x0, int x1,
+                          int y0, int y1)
+        {
+            int sx = source.sx;
+            int sy = source.sy;
+            // Columns read by the windows of the block
+            int first = std::max(x0 - radius, 0);
+            int last = std::min(x1 + radius, sx);
+
+            std::vector<histogram> columns(last - first);
+            auto column = [&](int x) -> histogram& {
+                return columns[std::clamp(x, 0, sx - 1) - first];
+            };
+            auto value = [&](int x, int y) {
+                y = std::clamp(y, 0, sy - 1);
+                return source.pixels[(y * sx + x) * 3 + c];
+            };
+
+            for (int x = first; x < last; x++)
+            {
+                std::memset(&column(x), 0, sizeof(histogram));
+                for (int y = y0 - radius; y <= y0 + radius; y++)
+                    count(column(x), value(x, y), 1);
+            }
+
+            window_histogram window;
+            for (int y = y0; y < y1; y++)
+            {
+                check_cancelled();
+
+                if (y > y0)
+                {
+                    for (int x = first; x < last; x++)
+                    {
+                        count(column(x), value(x, y - radius - 1), -1);
+                        count(column(x), value(x, y + radius), 1);
+                    }
+                }
+
+                reset(window, x0, radius, column);
+
+                uint8_t* out = target.pixels + y * sx * 3 + c;
+                for (int x = x0; x < x1; x++)
+                {
+                    out[x * 3] = rank_level(window, x, radius, rank, column);
+
+                    if (x + 1 < x1)
+                    {
+                        remove_bins(window.hist.coarse,
+                                    column(x - radius).coarse, coarse_bins);
+                        add_bins(window.hist.coarse,
+                                 column(x + radius + 1).coarse, coarse_bins);
+                    }
+                }
+            }
+        }
+    } // namespace
+
+    void percentile_filter(rgb24_image& image, int radius, float percent)
+    {
+        if (radius < 0 || radius > max_rank_radius)
+            throw std::invalid_argument("Unsupported rank filter radius");
+        if (radius == 0)
+            return;
+
+        int size = 2 * radius + 1;
+        int rank = std::clamp(
+            (int)std::lround(std::clamp(percent, 0.0f, 100.0f) / 100
+                             * (size * size - 1)),
+            0, size * size - 1);
+
+        std::unique_ptr<rgb24_image> source(new rgb24_image(image));
+
+        // Bands tall enough for the first rows of each to be amortized
+        int band_rows = std::max(4 * size, 64);
+        int bands = (image.sy + band_rows - 1) / band_rows;
+        int strips = (image.sx + strip_width - 1) / strip_width;
+
+        parallel_rows(bands * strips, [&](int begin, int end) {
+            for (int block = begin; block < end; block++)
+            {
+                int x0 = block % strips * strip_width;
+                int y0 = block / strips * band_rows;
+                int x1 = std::min(x0 + strip_width, image.sx);
+                int y1 = std::min(y0 + band_rows, image.sy);
+
+                for (int c = 0; c < 3; c++)
+                    filter_block(*source, image, c, radius, rank, x0, x1, y0,
+                                 y1);
+            }
+        });
+    }
+
+    void median_filter(rgb24_image& image, int radius)
+    {
+        percentile_filter(image, radius, 50);
+    }
+} // namespace tifo
@@ -0,0 +1,25 @@
+#ifndef TIFO_PROJECT_MEDIAN_HH
+#define TIFO_PROJECT_MEDIAN_HH
+
+#include "image.hh"
+
+namespace tifo
+{
+    /** Largest radius of the rank filters. */
+    constexpr int max_rank_radius = 127;
+
+    /**
+     * Replaces each channel of each pixel by the given percentile of the
+     * (2 radius + 1)^2 values around it, the borders being repeated. The
+     * cost per pixel does not depend on the radius (Perreault and Hebert):
+     * a histogram is kept for each column and slid down one row at a time,
+     * and the histogram of the window is slid right by adding a column and
+     * removing another.
+     */
+    void percentile_filter(rgb24_image& image, int radius, float percent);
+
+    /** percentile_filter at 50 %. */
+    void median_filter(rgb24_image& image, int radius);
+} // namespace tifo
+
+#endif //TIFO_PROJECT_MEDIAN_HH
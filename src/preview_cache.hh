@@ -0,0 +1,86 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <cstddef>
+#include <list>
+#include <utility>
+#include <vector>
+
+#include "editor_worker.hh"
+#include "region.hh"
+
+/**
+ * Identifies a slider preview: the history state it starts from, the
+ * slider and the value it was rendered for, the proxy level, the region of
+ * that level it covers (empty for all of it) and the settings of the other
+ * controls, which the previewed operation may read.
+ */
+struct PreviewKey
+{
+    quint64 state = 0;
+    const void* slider = nullptr;
+    int value = 0;
+    int level = 0;
+    tifo::image_rect region;
+    std::vector<int> settings;
+
+    bool operator==(const PreviewKey&) const = default;
+};
+
+/**
+ * Small least recently used cache of rendered previews. Lookups are linear:
+ * it only holds a handful of proxy sized images.
+ */
+class PreviewCache
+{
+public:
+    explicit PreviewCache(std::size_t capacity)
+        : capacity(capacity)
+    {}
+
+    ImagePtr find(const PreviewKey& key)
+    {
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (it->first == key)
+            {
+                entries.splice(entries.begin(), entries, it);
+                return it->second;
+            }
+        }
+        return nullptr;
+    }
+
+    bool contains(const PreviewKey& key) const
+    {
+        for (auto& entry : entries)
+        {
+            if (entry.first == key)
+                return true;
+        }
+        return false;
+    }
+
+    void insert(PreviewKey key, ImagePtr image)
+    {
+        if (find(key))
+        {
+            entries.front().second = std::move(image);
+            return;
+        }
+
+        entries.emplace_front(std::move(key), std::move(image));
+        if (entries.size() > capacity)
+            entries.pop_back();
+    }
+
+    void clear()
+    {
+        entries.clear();
+    }
+
+private:
+    std::size_t capacity;
+    std::list<std::pair<PreviewKey, ImagePtr>> entries;
+};
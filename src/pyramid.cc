@@ -0,0 +1,195 @@
+#include "pyramid.hh"
+
+#include <algorithm>
+
+#include "scheduler.hh"
+
+namespace tifo
+{
+    namespace
+    {
+        // Computes the pixels of half inside rect from the full size image
+        void downscale_half(const rgb24_image& image, rgb24_image& half,
+                            const image_rect& rect)
+        {
+            int sx = half.sx;
+
+            parallel_rows(rect.y1 - rect.y0, [&](int begin, int end) {
+                for (int y = rect.y0 + begin; y < rect.y0 + end; y++)
+                {
+                    const uint8_t* row0 = image.pixels + 2 * y * image.sx * 3;
+                    const uint8_t* row1 = 2 * y + 1 < image.sy
+                        ? row0 + image.sx * 3
+                        : row0;
+                    uint8_t* out = half.pixels + y * sx * 3;
+
+                    for (int x = rect.x0; x < rect.x1; x++)
+                    {
+                        int x0 = 2 * x * 3;
+                        int x1 = 2 * x + 1 < image.sx ? x0 + 3 : x0;
+
+                        for (int c = 0; c < 3; c++)
+                            out[x * 3 + c] =
+                                (row0[x0 + c] + row0[x1 + c] + row1[x0 + c]
+                                 + row1[x1 + c] + 2)
+                                / 4;
+                    }
+                }
+            });
+        }
+    } // namespace
+
+    rgb24_image* downscale_half(const rgb24_image& image)
+    {
+        int sx = (image.sx + 1) / 2;
+        int sy = (image.sy + 1) / 2;
+
+        auto half = new rgb24_image(sx, sy);
+        try
+        {
+            downscale_half(image, *half, { 0, 0, sx, sy });
+        }
+        catch (...)
+        {
+            delete half;
+            throw;
+        }
+
+        return half;
+    }
+
+    image_pyramid::image_pyramid(std::shared_ptr<const rgb24_image> base)
+        : base_image(std::move(base))
+    {
+        levels.push_back(base_image);
+    }
+
+    image_pyramid::image_pyramid(std::shared_ptr<const rgb24_image> base,
+                                 const image_pyramid& previous)
+        : base_image(std::move(base))
+    {
+        // Compared on first use, on the thread building the levels
+        auto& old = previous.base();
+        if (old.sx == base_image->sx && old.sy == base_image->sy)
+        {
+            std::lock_guard<std::mutex> lock(previous.mutex);
+            stale = previous.levels;
+        }
+
+        levels.push_back(base_image);
+    }
+
+    const rgb24_image& image_pyramid::base() const
+    {
+        return *base_image;
+    }
+
+    std::shared_ptr<const rgb24_image>
+    image_pyramid::next_level(const rgb24_image& last, std::size_t n)
+    {
+        if (n >= stale.size())
+        {
+            // Nothing left to reuse
+            stale.clear();
+            return std::shared_ptr<const rgb24_image>(downscale_half(last));
+        }
+
+        // Building a level may be cancelled: the state is only updated once
+        // it is done
+        if (stale[0])
+        {
+            changed = changed_rect(*stale[0], *base_image);
+            stale[0].reset();
+        }
+
+        auto rect = changed.halved();
+        auto& previous = *stale[n];
+        std::shared_ptr<const rgb24_image> half;
+
+        if (rect.empty())
+        {
+            half = stale[n];
+        }
+        else if (2 * rect.area() > (long)previous.sx * previous.sy)
+        {
+            // Mostly changed: no point in copying the previous level
+            half.reset(downscale_half(last));
+        }
+        else
+        {
+            auto patched = std::make_shared<rgb24_image>(previous);
+            downscale_half(last, *patched, rect);
+            half = std::move(patched);
+        }
+
+        changed = rect;
+        stale[n].reset();
+        return half;
+    }
+
+    std::shared_ptr<const rgb24_image> image_pyramid::level(int n)
+    {
+        // Levels already built are served without waiting for a build
+        auto built = [&]() -> std::shared_ptr<const rgb24_image> {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto& last = *levels.back();
+            if ((int)levels.size() > n || last.sx <= 1 || last.sy <= 1)
+                return levels[std::min<int>(n, levels.size() - 1)];
+            return nullptr;
+        };
+
+        if (auto level = built())
+            return level;
+
+        std::lock_guard<std::mutex> building(build_mutex);
+        for (;;)
+        {
+            if (auto level = built())
+                return level;
+
+            std::shared_ptr<const rgb24_image> last;
+            std::size_t count;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                last = levels.back();
+                count = levels.size();
+            }
+
+            // Downscaled without holding mutex, then published
+            auto next = next_level(*last, count);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            levels.push_back(std::move(next));
+        }
+    }
+
+    int image_pyramid::level_index_for(int width, int height) const
+    {
+        auto& image = base();
+
+        if (width <= 0 || height <= 0)
+            return 0;
+
+        double fit = std::min((double)width / image.sx,
+                              (double)height / image.sy);
+
+        int n = 0;
+        int sx = image.sx;
+        int sy = image.sy;
+        while (sx > 1 && sy > 1 && (sx + 1) / 2 >= image.sx * fit
+               && (sy + 1) / 2 >= image.sy * fit)
+        {
+            sx = (sx + 1) / 2;
+            sy = (sy + 1) / 2;
+            n++;
+        }
+
+        return n;
+    }
+
+    std::shared_ptr<const rgb24_image> image_pyramid::level_for(int width,
+                                                                int height)
+    {
+        return level(level_index_for(width, height));
+    }
+} // namespace tifo
@@ -0,0 +1,74 @@
+#ifndef TIFO_PROJECT_PYRAMID_HH
+#define TIFO_PROJECT_PYRAMID_HH
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "image.hh"
+#include "region.hh"
+
+namespace tifo
+{
+    /**
+     * Halves the image in both directions with a 2x2 box filter. Odd
+     * borders are averaged with themselves.
+     */
+    rgb24_image* downscale_half(const rgb24_image& image);
+
+    /**
+     * Mip levels of an image, each one half the size of the previous.
+     * Level 0 is the image itself; the others are built on first use and
+     * shared between threads.
+     */
+    class image_pyramid
+    {
+    public:
+        explicit image_pyramid(std::shared_ptr<const rgb24_image> base);
+
+        /**
+         * Pyramid of a new version of an image: the levels of the previous
+         * one already built are reused, only the area where the two images
+         * differ being downscaled again.
+         */
+        image_pyramid(std::shared_ptr<const rgb24_image> base,
+                      const image_pyramid& previous);
+
+        /** Level n, clamped to the smallest one (1 pixel wide or high). */
+        std::shared_ptr<const rgb24_image> level(int n);
+
+        /**
+         * Smallest level still at least as large as the base image fitted
+         * (keeping its aspect ratio) in a width x height viewport.
+         */
+        std::shared_ptr<const rgb24_image> level_for(int width, int height);
+
+        int level_index_for(int width, int height) const;
+
+        const rgb24_image& base() const;
+
+    private:
+        /** Builds the level after last, which is level n - 1. */
+        std::shared_ptr<const rgb24_image> next_level(const rgb24_image& last,
+                                                      std::size_t n);
+
+        /** Level 0, never replaced, read without locking. */
+        const std::shared_ptr<const rgb24_image> base_image;
+
+        /** Guards levels, only held to read or publish one. */
+        mutable std::mutex mutex;
+        std::vector<std::shared_ptr<const rgb24_image>> levels;
+
+        /**
+         * Held while a level is built, so that only one thread builds
+         * them; guards stale and changed.
+         */
+        std::mutex build_mutex;
+        /** Levels of the previous version, until reused. */
+        std::vector<std::shared_ptr<const rgb24_image>> stale;
+        /** Area of the last built level that differs from the stale one. */
+        image_rect changed;
+    };
+} // namespace tifo
+
+#endif //TIFO_PROJECT_PYRAMID_HH
@@ -0,0 +1,75 @@
+#include "region.hh"
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "scheduler.hh"
+
+namespace tifo
+{
+    image_rect changed_rect(const rgb24_image& a, const rgb24_image& b)
+    {
+        std::vector<int> first(a.sy, a.sx);
+        std::vector<int> last(a.sy, -1);
+
+        parallel_rows(a.sy, [&](int begin, int end) {
+            for (int y = begin; y < end; y++)
+            {
+                const uint8_t* row_a = a.pixels + y * a.sx * 3;
+                const uint8_t* row_b = b.pixels + y * a.sx * 3;
+
+                if (std::memcmp(row_a, row_b, a.sx * 3) == 0)
+                    continue;
+
+                int x = 0;
+                while (std::memcmp(row_a + x * 3, row_b + x * 3, 3) == 0)
+                    x++;
+                first[y] = x;
+
+                x = a.sx - 1;
+                while (std::memcmp(row_a + x * 3, row_b + x * 3, 3) == 0)
+                    x--;
+                last[y] = x;
+            }
+        });
+
+        image_rect rect;
+        for (int y = 0; y < a.sy; y++)
+        {
+            if (last[y] < 0)
+                continue;
+            rect = rect.united({ first[y], y, last[y] + 1, y + 1 });
+        }
+
+        return rect;
+    }
+
+    rgb24_image* crop(const rgb24_image& image, const image_rect& rect)
+    {
+        if (rect.empty() || rect.x0 < 0 || rect.y0 < 0 || rect.x1 > image.sx
+            || rect.y1 > image.sy)
+            throw std::invalid_argument("Crop outside of the image");
+
+        auto result = new rgb24_image(rect.x1 - rect.x0, rect.y1 - rect.y0);
+        int row_bytes = result->sx * 3;
+
+        try
+        {
+            parallel_rows(result->sy, [&](int begin, int end) {
+                for (int y = begin; y < end; y++)
+                    std::memcpy(result->pixels + y * row_bytes,
+                                image.pixels
+                                    + ((rect.y0 + y) * image.sx + rect.x0) * 3,
+                                row_bytes);
+            });
+        }
+        catch (...)
+        {
+            delete result;
+            throw;
+        }
+
+        return result;
+    }
+} // namespace tifo
@@ -0,0 +1,82 @@
+#ifndef TIFO_PROJECT_REGION_HH
+#define TIFO_PROJECT_REGION_HH
+
+#include <algorithm>
+
+#include "image.hh"
+
+namespace tifo
+{
+    /**
+     * Rectangle of pixels [x0, x1) x [y0, y1).
+     */
+    struct image_rect
+    {
+        int x0 = 0;
+        int y0 = 0;
+        int x1 = 0;
+        int y1 = 0;
+
+        bool empty() const
+        {
+            return x0 >= x1 || y0 >= y1;
+        }
+
+        long area() const
+        {
+            return empty() ? 0 : (long)(x1 - x0) * (y1 - y0);
+        }
+
+        bool operator==(const image_rect&) const = default;
+
+        /** Pixels of the next pyramid level depending on this rectangle. */
+        image_rect halved() const
+        {
+            return { x0 / 2, y0 / 2, (x1 + 1) / 2, (y1 + 1) / 2 };
+        }
+
+        /** Pixels of pyramid level n covering this rectangle of level 0. */
+        image_rect at_level(int n) const
+        {
+            int round = (1 << n) - 1;
+            return { x0 >> n, y0 >> n, (x1 + round) >> n, (y1 + round) >> n };
+        }
+
+        image_rect expanded(int margin) const
+        {
+            return { x0 - margin, y0 - margin, x1 + margin, y1 + margin };
+        }
+
+        image_rect intersected(const image_rect& other) const
+        {
+            return { std::max(x0, other.x0), std::max(y0, other.y0),
+                     std::min(x1, other.x1), std::min(y1, other.y1) };
+        }
+
+        image_rect translated(int dx, int dy) const
+        {
+            return { x0 + dx, y0 + dy, x1 + dx, y1 + dy };
+        }
+
+        image_rect united(const image_rect& other) const
+        {
+            if (empty())
+                return other;
+            if (other.empty())
+                return *this;
+            return { std::min(x0, other.x0), std::min(y0, other.y0),
+                     std::max(x1, other.x1), std::max(y1, other.y1) };
+        }
+    };
+
+    /**
+     * Bounding box of the pixels that differ between two images of the same
+     * size, empty when they are equal.
+     */
+    image_rect changed_rect(const rgb24_image& a, const rgb24_image& b);
+
+    /** Copy of a rectangle, which must lie inside the image. */
+    rgb24_image* crop(const rgb24_image& image, const image_rect& rect);
+} // namespace tifo
+
+#endif //TIFO_PROJECT_REGION_HH
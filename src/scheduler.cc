@@ -0,0 +1,262 @@
+#include "scheduler.hh"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tifo
+{
+    namespace
+    {
+        thread_local job_context* bound_job = nullptr;
+        thread_local bool in_band = false;
+
+        struct band_task
+        {
+            const std::function<void(int, int)>* body;
+            job_context* job;
+            int rows;
+            int band_size;
+            int nb_bands;
+
+            std::atomic<int> next{ 0 };
+            std::atomic<int> finished{ 0 };
+            std::atomic<int> reported{ -1 };
+
+            std::mutex mutex;
+            std::condition_variable done;
+            /** Set under mutex, along with the first error. */
+            std::exception_ptr error;
+            /** Stops the bands not started yet once one failed. */
+            std::atomic<bool> failed{ false };
+        };
+
+        // Runs bands of the task until there is none left to claim.
+        void run_bands(band_task& task)
+        {
+            int band;
+            while ((band = task.next.fetch_add(1)) < task.nb_bands)
+            {
+                if (!task.failed.load()
+                    && !(task.job && task.job->is_cancelled()))
+                {
+                    int begin = band * task.band_size;
+                    int end = std::min(task.rows, begin + task.band_size);
+
+                    in_band = true;
+                    try
+                    {
+                        (*task.body)(begin, end);
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lock(task.mutex);
+                        if (!task.error)
+                            task.error = std::current_exception();
+                        task.failed.store(true);
+                    }
+                    in_band = false;
+                }
+
+                // The job may be gone as soon as the last band is counted
+                // as finished, the caller then returning: report before
+                if (task.job && task.job->progress
+                    && !task.job->is_cancelled())
+                {
+                    int percent =
+                        (task.finished.load() + 1) * 100 / task.nb_bands;
+                    int last = task.reported.load();
+                    if (percent > last
+                        && task.reported.compare_exchange_strong(last,
+                                                                 percent))
+                        task.job->progress(percent);
+                }
+
+                int count = task.finished.fetch_add(1) + 1;
+                if (count == task.nb_bands)
+                {
+                    std::lock_guard<std::mutex> lock(task.mutex);
+                    task.done.notify_all();
+                }
+            }
+        }
+
+        class thread_pool
+        {
+        public:
+            thread_pool()
+            {
+                int count =
+                    std::max(1u, std::thread::hardware_concurrency()) - 1;
+                for (int i = 0; i < count; i++)
+                    threads.emplace_back([this]() { work(); });
+            }
+
+            ~thread_pool()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    stop = true;
+                }
+                wake.notify_all();
+                for (auto& thread : threads)
+                    thread.join();
+            }
+
+            void run(const std::shared_ptr<band_task>& task)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    tasks.push_back(task);
+                }
+                wake.notify_all();
+
+                run_bands(*task);
+
+                {
+                    std::unique_lock<std::mutex> lock(task->mutex);
+                    task->done.wait(lock, [&]() {
+                        return task->finished.load() == task->nb_bands;
+                    });
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = std::find(tasks.begin(), tasks.end(), task);
+                if (it != tasks.end())
+                    tasks.erase(it);
+            }
+
+            int size() const
+            {
+                return threads.size() + 1;
+            }
+
+        private:
+            void work()
+            {
+                for (;;)
+                {
+                    std::shared_ptr<band_task> task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        wake.wait(lock,
+                                  [this]() { return stop || !tasks.empty(); });
+                        if (stop)
+                            return;
+
+                        task = tasks.front();
+                        if (task->next.load() >= task->nb_bands)
+                        {
+                            tasks.pop_front();
+                            continue;
+                        }
+                    }
+
+                    run_bands(*task);
+                }
+            }
+
+            std::vector<std::thread> threads;
+            std::deque<std::shared_ptr<band_task>> tasks;
+            std::mutex mutex;
+            std::condition_variable wake;
+            bool stop = false;
+        };
+
+        thread_pool& pool()
+        {
+            static thread_pool instance;
+            return instance;
+        }
+    } // namespace
+
+    job_scope::job_scope(job_context* job)
+        : previous(bound_job)
+    {
+        bound_job = job;
+    }
+
+    job_scope::~job_scope()
+    {
+        bound_job = previous;
+    }
+
+    job_context* current_job()
+    {
+        return bound_job;
+    }
+
+    void check_cancelled()
+    {
+        if (bound_job && bound_job->is_cancelled())
+            throw cancelled();
+    }
+
+    int thread_count()
+    {
+        return pool().size();
+    }
+
+    void parallel_rows(int rows, const std::function<void(int, int)>& body)
+    {
+        check_cancelled();
+
+        if (rows <= 0)
+            return;
+
+        if (in_band)
+        {
+            body(0, rows);
+            return;
+        }
+
+        if (bound_job && bound_job->background)
+        {
+            int band_size = std::max(8, rows / 16);
+            for (int begin = 0; begin < rows; begin += band_size)
+            {
+                check_cancelled();
+
+                in_band = true;
+                try
+                {
+                    body(begin, std::min(rows, begin + band_size));
+                }
+                catch (...)
+                {
+                    in_band = false;
+                    throw;
+                }
+                in_band = false;
+            }
+            return;
+        }
+
+        // A few bands per thread keeps them balanced while bounding the
+        // cancellation latency to one band.
+        int band_size = std::max(8, rows / (thread_count() * 4));
+
+        auto task = std::make_shared<band_task>();
+        task->body = &body;
+        task->job = bound_job;
+        task->rows = rows;
+        task->band_size = band_size;
+        task->nb_bands = (rows + band_size - 1) / band_size;
+
+        pool().run(task);
+
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(task->mutex);
+            error = task->error;
+        }
+        if (error)
+            std::rethrow_exception(error);
+
+        check_cancelled();
+    }
+} // namespace tifo
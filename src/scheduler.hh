@@ -0,0 +1,82 @@
+#ifndef TIFO_PROJECT_SCHEDULER_HH
+#define TIFO_PROJECT_SCHEDULER_HH
+
+#include <atomic>
+#include <exception>
+#include <functional>
+
+namespace tifo
+{
+    /**
+     * Thrown out of a kernel when the job it runs for has been cancelled.
+     */
+    class cancelled : public std::exception
+    {
+    public:
+        const char* what() const noexcept override
+        {
+            return "tifo job cancelled";
+        }
+    };
+
+    /**
+     * Cancellation token and progress sink of one editor job. Kernels never
+     * see it directly: it is bound to the calling thread with job_scope and
+     * checked by parallel_rows between row bands.
+     */
+    struct job_context
+    {
+        std::atomic<bool> cancel_requested{ false };
+        /** Called with the completion (0-100) of the current pass. */
+        std::function<void(int)> progress;
+        /**
+         * Background jobs run their bands on their own thread only, leaving
+         * the shared threads to the interactive ones.
+         */
+        bool background = false;
+
+        void cancel()
+        {
+            cancel_requested = true;
+        }
+
+        bool is_cancelled() const
+        {
+            return cancel_requested;
+        }
+    };
+
+    /**
+     * Binds a job to the current thread for the lifetime of the scope.
+     */
+    class job_scope
+    {
+    public:
+        explicit job_scope(job_context* job);
+        ~job_scope();
+
+    private:
+        job_context* previous;
+    };
+
+    job_context* current_job();
+
+    /**
+     * Throws tifo::cancelled if the job bound to this thread was cancelled.
+     */
+    void check_cancelled();
+
+    /**
+     * Splits [0, rows) in bands and runs body(begin, end) on each of them
+     * with the shared worker threads. The current job is checked between
+     * bands: once cancelled no new band starts and tifo::cancelled is thrown
+     * after the running ones finished. Nested calls and background jobs
+     * run inline.
+     */
+    void parallel_rows(int rows, const std::function<void(int, int)>& body);
+
+    /** Number of threads parallel_rows spreads the bands on. */
+    int thread_count();
+} // namespace tifo
+
+#endif //TIFO_PROJECT_SCHEDULER_HH
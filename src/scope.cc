@@ -0,0 +1,138 @@
+#include "scope.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "histogram.hh"
+#include "scheduler.hh"
+
+namespace tifo
+{
+    namespace
+    {
+        constexpr uint8_t background = 32;
+        constexpr uint8_t luma_fill = 96;
+        constexpr uint8_t channel_fill = 220;
+
+        // A waveform cell is as bright as this many times the density of a
+        // column whose levels would be spread evenly over the height
+        constexpr int waveform_saturation = 4;
+        constexpr int waveform_floor = 48;
+
+        // Height in pixels of the bar of a count, a pixel at least when
+        // the count is not null
+        int bar_height(unsigned int count, unsigned int peak, int height)
+        {
+            unsigned long long bar =
+                ((unsigned long long)count * height + peak - 1) / peak;
+            return std::min<unsigned long long>(bar, height);
+        }
+    } // namespace
+
+    rgb24_image* histogram_scope(const rgb24_image& image, int height)
+    {
+        if (height < 1)
+            throw std::invalid_argument("Empty scope");
+
+        auto hist = rgb_histograms(image);
+        const histogram_1d* channels[3] = { &hist.red, &hist.green,
+                                            &hist.blue };
+
+        unsigned int peak = 1;
+        for (int level = 1; level < IMAGE_MAX_LEVEL; level++)
+        {
+            peak = std::max(peak, hist.luma.histogram[level]);
+            for (auto channel : channels)
+                peak = std::max(peak, channel->histogram[level]);
+        }
+
+        auto result = new rgb24_image(scope_levels, height);
+        for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+        {
+            int luma = bar_height(hist.luma.histogram[level], peak, height);
+            int bars[3];
+            for (int c = 0; c < 3; c++)
+                bars[c] =
+                    bar_height(channels[c]->histogram[level], peak, height);
+
+            for (int y = 0; y < height; y++)
+            {
+                // Bars grow from the bottom
+                int above = height - 1 - y;
+                uint8_t* pixel =
+                    result->pixels + (y * scope_levels + level) * 3;
+                uint8_t base = above < luma ? luma_fill : background;
+                for (int c = 0; c < 3; c++)
+                    pixel[c] = above < bars[c] ? channel_fill : base;
+            }
+        }
+        return result;
+    }
+
+    rgb24_image* waveform_scope(const rgb24_image& image, int width,
+                                int height)
+    {
+        if (width < 1 || height < 1)
+            throw std::invalid_argument("Empty scope");
+
+        // Column of the image starting each column of the scope
+        auto first_column = [&](int column) {
+            return (int)(((long long)column * image.sx + width - 1) / width);
+        };
+        std::vector<int> scope_column(image.sx);
+        for (int x = 0; x < image.sx; x++)
+            scope_column[x] = (long long)x * width / image.sx;
+
+        // Each band counts the levels of its own columns of the scope, down
+        // the strip of the image they gather
+        std::vector<unsigned int> counts((size_t)width * IMAGE_NB_LEVELS);
+        parallel_rows(width, [&](int begin, int end) {
+            int x0 = first_column(begin);
+            int x1 = first_column(end);
+            for (int y = 0; y < image.sy; y++)
+            {
+                const uint8_t* pixel = image.pixels + (y * image.sx + x0) * 3;
+                for (int x = x0; x < x1; x++, pixel += 3)
+                    counts[scope_column[x] * IMAGE_NB_LEVELS
+                           + (pixel[0] + pixel[1] + pixel[2]) / 3]++;
+            }
+        });
+
+        auto result = new rgb24_image(width, height);
+        std::memset(result->pixels, 0, (size_t)width * height * 3);
+
+        std::vector<unsigned long long> rows(height);
+        for (int column = 0; column < width; column++)
+        {
+            unsigned long long pixels =
+                (unsigned long long)(first_column(column + 1)
+                                     - first_column(column))
+                * image.sy;
+            if (pixels == 0)
+                continue;
+
+            std::fill(rows.begin(), rows.end(), 0);
+            const unsigned int* levels = counts.data()
+                + (size_t)column * IMAGE_NB_LEVELS;
+            for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+                rows[(IMAGE_MAX_LEVEL - level) * (height - 1)
+                     / IMAGE_MAX_LEVEL] += levels[level];
+
+            for (int y = 0; y < height; y++)
+            {
+                if (rows[y] == 0)
+                    continue;
+
+                unsigned long long brightness = waveform_floor
+                    + rows[y] * height * (IMAGE_MAX_LEVEL - waveform_floor)
+                        / (waveform_saturation * pixels);
+                uint8_t* pixel = result->pixels + (y * width + column) * 3;
+                pixel[0] = pixel[1] = pixel[2] =
+                    std::min<unsigned long long>(brightness, IMAGE_MAX_LEVEL);
+            }
+        }
+        return result;
+    }
+} // namespace tifo
@@ -0,0 +1,30 @@
+#ifndef TIFO_PROJECT_SCOPE_HH
+#define TIFO_PROJECT_SCOPE_HH
+
+#include "image.hh"
+
+namespace tifo
+{
+    /** Width of a histogram scope: one column per level. */
+    constexpr int scope_levels = IMAGE_NB_LEVELS;
+
+    /**
+     * Draws the red, green and blue histograms of the image over its gray
+     * level one, as filled curves on a dark background, in a new image of
+     * scope_levels x height pixels. The counts are scaled to the highest
+     * level between the two extremes, so that clipped pixels do not
+     * flatten the rest of the curves.
+     */
+    rgb24_image* histogram_scope(const rgb24_image& image, int height);
+
+    /**
+     * Waveform of the gray level: column x of the new width x height image
+     * shows how the levels of the matching columns of the image are spread,
+     * from black at the bottom to white at the top, the brighter the more
+     * pixels have them.
+     */
+    rgb24_image* waveform_scope(const rgb24_image& image, int width,
+                                int height);
+} // namespace tifo
+
+#endif //TIFO_PROJECT_SCOPE_HH
@@ -0,0 +1,232 @@
+#include "selection.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "scheduler.hh"
+
+namespace tifo
+{
+    namespace
+    {
+        // Adds weight times the part of each pixel of row covered by [a, b)
+        void add_span(std::vector<float>& row, float a, float b, float weight)
+        {
+            float width = row.size();
+            a = std::clamp(a, 0.0f, width);
+            b = std::clamp(b, 0.0f, width);
+            if (a >= b)
+                return;
+
+            int first = a;
+            int last = b;
+            if (first == last)
+            {
+                row[first] += (b - a) * weight;
+                return;
+            }
+
+            row[first] += (first + 1 - a) * weight;
+            for (int x = first + 1; x < last; x++)
+                row[x] += weight;
+            if (last < (int)row.size())
+                row[last] += (b - last) * weight;
+        }
+    } // namespace
+
+    uint8_t selection::at(int x, int y) const
+    {
+        if (x < bounds.x0 || x >= bounds.x1 || y < bounds.y0 || y >= bounds.y1)
+            return 0;
+
+        return coverage[(long)(y - bounds.y0) * (bounds.x1 - bounds.x0) + x
+                        - bounds.x0];
+    }
+
+    selection selection::translated(int dx, int dy) const
+    {
+        return { bounds.translated(dx, dy), coverage };
+    }
+
+    selection selection::at_level(int n) const
+    {
+        if (n == 0 || empty())
+            return *this;
+
+        selection result;
+        result.bounds = bounds.at_level(n);
+
+        int width = bounds.x1 - bounds.x0;
+        int w = result.bounds.x1 - result.bounds.x0;
+        int h = result.bounds.y1 - result.bounds.y0;
+        int block = 1 << n;
+        result.coverage.assign((long)w * h, 0);
+
+        parallel_rows(h, [&](int begin, int end) {
+            std::vector<int> sums(w);
+            for (int y = begin; y < end; y++)
+            {
+                std::fill(sums.begin(), sums.end(), 0);
+
+                int top = std::max((result.bounds.y0 + y) << n, bounds.y0);
+                int bottom =
+                    std::min((result.bounds.y0 + y + 1) << n, bounds.y1);
+                for (int sy = top; sy < bottom; sy++)
+                {
+                    const uint8_t* row =
+                        coverage.data() + (long)(sy - bounds.y0) * width;
+                    for (int sx = bounds.x0; sx < bounds.x1; sx++)
+                        sums[(sx >> n) - result.bounds.x0] +=
+                            row[sx - bounds.x0];
+                }
+
+                uint8_t* out = result.coverage.data() + (long)y * w;
+                for (int x = 0; x < w; x++)
+                    out[x] = (sums[x] + block * block / 2) / (block * block);
+            }
+        });
+
+        return result;
+    }
+
+    selection rect_selection(const image_rect& rect, int sx, int sy)
+    {
+        selection result;
+        result.bounds = rect.intersected({ 0, 0, sx, sy });
+        if (!result.empty())
+            result.coverage.assign(result.bounds.area(), 255);
+
+        return result;
+    }
+
+    selection freehand_selection(const std::vector<outline_point>& outline,
+                                 int sx, int sy)
+    {
+        selection result;
+        if (outline.size() < 3)
+            return result;
+
+        float min_x = outline[0].x;
+        float min_y = outline[0].y;
+        float max_x = min_x;
+        float max_y = min_y;
+        for (auto& point : outline)
+        {
+            min_x = std::min(min_x, point.x);
+            min_y = std::min(min_y, point.y);
+            max_x = std::max(max_x, point.x);
+            max_y = std::max(max_y, point.y);
+        }
+
+        image_rect box{ (int)std::floor(min_x), (int)std::floor(min_y),
+                        (int)std::ceil(max_x), (int)std::ceil(max_y) };
+        auto bounds = box.intersected({ 0, 0, sx, sy });
+        if (bounds.empty())
+            return result;
+
+        int w = bounds.x1 - bounds.x0;
+        int h = bounds.y1 - bounds.y0;
+        std::vector<uint8_t> coverage((long)w * h, 0);
+
+        constexpr int samples = 4;
+        parallel_rows(h, [&](int begin, int end) {
+            std::vector<float> row(w);
+            std::vector<float> crossings;
+
+            for (int y = begin; y < end; y++)
+            {
+                std::fill(row.begin(), row.end(), 0.0f);
+
+                for (int s = 0; s < samples; s++)
+                {
+                    float py = bounds.y0 + y + (s + 0.5f) / samples;
+
+                    crossings.clear();
+                    for (std::size_t i = 0; i < outline.size(); i++)
+                    {
+                        auto& a = outline[i];
+                        auto& b = outline[(i + 1) % outline.size()];
+                        if ((a.y <= py) == (b.y <= py))
+                            continue;
+                        crossings.push_back(a.x
+                                            + (py - a.y) * (b.x - a.x)
+                                                / (b.y - a.y));
+                    }
+                    std::sort(crossings.begin(), crossings.end());
+
+                    for (std::size_t i = 0; i + 1 < crossings.size(); i += 2)
+                        add_span(row, crossings[i] - bounds.x0,
+                                 crossings[i + 1] - bounds.x0,
+                                 1.0f / samples);
+                }
+
+                uint8_t* out = coverage.data() + (long)y * w;
+                for (int x = 0; x < w; x++)
+                    out[x] = std::lround(std::min(row[x], 1.0f) * 255);
+            }
+        });
+
+        result.bounds = bounds;
+        result.coverage = std::move(coverage);
+        return result;
+    }
+
+    rgb24_image* apply_in_selection(
+        const rgb24_image& image, const selection& selected, int halo,
+        const std::function<rgb24_image*(const rgb24_image&)>& operation)
+    {
+        image_rect full{ 0, 0, image.sx, image.sy };
+        auto inside = selected.bounds.intersected(full);
+        if (inside.empty())
+            return new rgb24_image(image);
+
+        auto area = inside.expanded(halo).intersected(full);
+        auto input = crop(image, area);
+        rgb24_image* output = nullptr;
+        rgb24_image* result = nullptr;
+
+        try
+        {
+            output = operation(*input);
+            if (output->sx != input->sx || output->sy != input->sy)
+                throw std::invalid_argument(
+                    "The operation changes the size of the selection");
+
+            result = new rgb24_image(image);
+
+            int width = selected.bounds.x1 - selected.bounds.x0;
+            parallel_rows(inside.y1 - inside.y0, [&](int begin, int end) {
+                for (int y = inside.y0 + begin; y < inside.y0 + end; y++)
+                {
+                    const uint8_t* mask = selected.coverage.data()
+                        + (long)(y - selected.bounds.y0) * width;
+                    const uint8_t* processed =
+                        output->pixels + (y - area.y0) * output->sx * 3;
+                    uint8_t* out = result->pixels + y * image.sx * 3;
+
+                    for (int x = inside.x0; x < inside.x1; x++)
+                    {
+                        int m = mask[x - selected.bounds.x0];
+                        const uint8_t* in = processed + (x - area.x0) * 3;
+                        for (int c = 0; c < 3; c++)
+                            out[x * 3 + c] =
+                                (out[x * 3 + c] * (255 - m) + in[c] * m + 127)
+                                / 255;
+                    }
+                }
+            });
+        }
+        catch (...)
+        {
+            delete input;
+            delete output;
+            delete result;
+            throw;
+        }
+
+        delete input;
+        delete output;
+        return result;
+    }
+} // namespace tifo
@@ -0,0 +1,67 @@
+#ifndef TIFO_PROJECT_SELECTION_HH
+#define TIFO_PROJECT_SELECTION_HH
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "image.hh"
+#include "region.hh"
+
+namespace tifo
+{
+    /** Point of a selection outline, in pixels of the image. */
+    struct outline_point
+    {
+        float x = 0;
+        float y = 0;
+    };
+
+    /**
+     * Part of an image selected for editing, with the coverage of each
+     * pixel: 255 inside, 0 outside and in between along antialiased edges.
+     * Only the bounding box of the selected pixels is stored.
+     */
+    struct selection
+    {
+        image_rect bounds;
+        /** Coverage of the pixels of bounds, row after row. */
+        std::vector<uint8_t> coverage;
+
+        bool empty() const
+        {
+            return bounds.empty();
+        }
+
+        /** Coverage of a pixel, 0 outside of the bounds. */
+        uint8_t at(int x, int y) const;
+
+        selection translated(int dx, int dy) const;
+
+        /** Same selection on pyramid level n, the coverage being averaged. */
+        selection at_level(int n) const;
+    };
+
+    /** Selection of a rectangle, clipped to a sx x sy image. */
+    selection rect_selection(const image_rect& rect, int sx, int sy);
+
+    /**
+     * Selection of the inside of a closed outline (even-odd rule), clipped
+     * to a sx x sy image. Edges are antialiased over 4 samples per row.
+     */
+    selection freehand_selection(const std::vector<outline_point>& outline,
+                                 int sx, int sy);
+
+    /**
+     * Applies an operation to the selected pixels only. The bounding box of
+     * the selection, widened by the halo of pixels the operation reads
+     * around the ones it computes, is cut out and processed alone; the
+     * result is then blended over a copy of the image, weighted by the
+     * coverage. The operation must keep the size of its input.
+     */
+    rgb24_image* apply_in_selection(
+        const rgb24_image& image, const selection& selected, int halo,
+        const std::function<rgb24_image*(const rgb24_image&)>& operation);
+} // namespace tifo
+
+#endif //TIFO_PROJECT_SELECTION_HH
@@ -0,0 +1,87 @@
+#include "stats.hh"
+
+#include <cmath>
+
+#include "histogram_operations.hh"
+
+namespace tifo
+{
+    double channel_stats::mean() const
+    {
+        return count == 0 ? 0 : (double)sum / count;
+    }
+
+    double channel_stats::variance() const
+    {
+        if (count == 0)
+            return 0;
+
+        // Around the mean rather than from the sum of the squares, which
+        // would cancel out for large flat images
+        double average = mean();
+        double squares = 0;
+        for (int level = min; level <= max; level++)
+        {
+            double deviation = level - average;
+            squares += histogram.histogram[level] * deviation * deviation;
+        }
+        return squares / count;
+    }
+
+    double channel_stats::standard_deviation() const
+    {
+        return std::sqrt(variance());
+    }
+
+    int channel_stats::percentile(float percent) const
+    {
+        return tifo::percentile(histogram, percent);
+    }
+
+    channel_stats histogram_stats(const histogram_1d& hist)
+    {
+        channel_stats stats;
+        stats.histogram = hist;
+
+        bool first = true;
+        for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+        {
+            unsigned int n = hist.histogram[level];
+            if (n == 0)
+                continue;
+
+            if (first)
+            {
+                stats.min = level;
+                first = false;
+            }
+            stats.max = level;
+            stats.count += n;
+            stats.sum += (unsigned long long)n * level;
+        }
+        return stats;
+    }
+
+    channel_stats image_stats(const gray8_image& image)
+    {
+        return histogram_stats(gray_histogram(image));
+    }
+
+    channel_stats image_stats(const gray8_image& image,
+                              const image_rect& rect)
+    {
+        return histogram_stats(gray_histogram(image, rect));
+    }
+
+    rgb_stats image_stats(const rgb24_image& image)
+    {
+        return image_stats(image, { 0, 0, image.sx, image.sy });
+    }
+
+    rgb_stats image_stats(const rgb24_image& image, const image_rect& rect)
+    {
+        auto hist = rgb_histograms(image, rect);
+        return { histogram_stats(hist.red), histogram_stats(hist.green),
+                 histogram_stats(hist.blue), histogram_stats(hist.luma) };
+    }
+} // namespace tifo
@@ -0,0 +1,56 @@
+#ifndef TIFO_PROJECT_STATS_HH
+#define TIFO_PROJECT_STATS_HH
+
+#include "histogram.hh"
+#include "image.hh"
+#include "region.hh"
+
+namespace tifo
+{
+    /**
+     * Statistics of the values of one channel, all derived exactly from
+     * its histogram.
+     */
+    struct channel_stats
+    {
+        /** Number of values. */
+        unsigned long count = 0;
+        /** Smallest and largest values, 0 when there are none. */
+        int min = 0;
+        int max = 0;
+        unsigned long long sum = 0;
+        histogram_1d histogram{};
+
+        /** 0 when there are no values. */
+        double mean() const;
+        /** Population variance, 0 when there are no values. */
+        double variance() const;
+        double standard_deviation() const;
+        /** Lowest value with at least percent % of them at or below it. */
+        int percentile(float percent) const;
+    };
+
+    /** Statistics of the three channels and of the gray level (R+G+B)/3. */
+    struct rgb_stats
+    {
+        channel_stats red;
+        channel_stats green;
+        channel_stats blue;
+        channel_stats luma;
+    };
+
+    channel_stats histogram_stats(const histogram_1d& hist);
+
+    /*
+     * The pixels are read once, by the parallel counting of histogram.hh;
+     * the statistics then only go over the 256 levels. The rectangle is
+     * clipped to the image.
+     */
+    channel_stats image_stats(const gray8_image& image);
+    channel_stats image_stats(const gray8_image& image,
+                              const image_rect& rect);
+    rgb_stats image_stats(const rgb24_image& image);
+    rgb_stats image_stats(const rgb24_image& image, const image_rect& rect);
+} // namespace tifo
+
+#endif //TIFO_PROJECT_STATS_HH
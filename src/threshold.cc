@@ -0,0 +1,214 @@
+#include "threshold.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "integral.hh"
+#include "scheduler.hh"
+
+namespace tifo
+{
+    namespace
+    {
+        // A band reads radius rows above and below its own, so the bands
+        // are kept tall enough for the table rows to be mostly its own
+        int band_rows(int radius)
+        {
+            return std::max(64, 4 * (2 * radius + 1));
+        }
+
+        // Runs decide(pixel, window, table) on each pixel, band by band,
+        // each band building the table of its rows and their margin
+        template <typename Build, typename Decide>
+        gray8_image* local_binarize(const gray8_image& image, int radius,
+                                    Build build, Decide decide)
+        {
+            if (radius < 0)
+                throw std::invalid_argument("Negative threshold radius");
+
+            auto result = new gray8_image(image.sx, image.sy);
+            int rows = band_rows(radius);
+            int bands = (image.sy + rows - 1) / rows;
+
+            parallel_rows(bands, [&](int begin, int end) {
+                for (int band = begin; band < end; band++)
+                {
+                    int y0 = band * rows;
+                    int y1 = std::min(y0 + rows, image.sy);
+                    auto table = build(image_rect{ 0, y0 - radius, image.sx,
+                                                   y1 + radius }
+                                           .intersected({ 0, 0, image.sx,
+                                                          image.sy }));
+
+                    for (int y = y0; y < y1; y++)
+                    {
+                        const uint8_t* in = image.pixels + y * image.sx;
+                        uint8_t* out = result->pixels + y * image.sx;
+                        int top = std::max(y - radius, 0);
+                        int bottom = std::min(y + radius + 1, image.sy);
+
+                        for (int x = 0; x < image.sx; x++)
+                        {
+                            image_rect window{ std::max(x - radius, 0), top,
+                                               std::min(x + radius + 1,
+                                                        image.sx),
+                                               bottom };
+                            out[x] = decide(in[x], window, table) ? 255 : 0;
+                        }
+                    }
+                }
+            });
+
+            return result;
+        }
+
+        template <typename Sum>
+        gray8_image* sauvola(const gray8_image& image, int radius, float k,
+                             float range)
+        {
+            return local_binarize(
+                image, radius,
+                [&](const image_rect& rect) {
+                    return make_moments<Sum>(image, rect);
+                },
+                [&](uint8_t pixel, const image_rect& window,
+                    const integral_moments<Sum>& table) {
+                    double mean = table.rect_mean(window);
+                    double deviation = table.rect_stddev(window);
+                    return pixel > mean * (1 + k * (deviation / range - 1));
+                });
+        }
+
+        template <typename Sum>
+        gray8_image* bradley(const gray8_image& image, int radius, float t)
+        {
+            return local_binarize(
+                image, radius,
+                [&](const image_rect& rect) {
+                    return make_integral<Sum>(image, rect);
+                },
+                [&](uint8_t pixel, const image_rect& window,
+                    const integral_image<Sum>& table) {
+                    return (double)pixel * window.area()
+                        > table.rect_sum(window) * (1.0 - t);
+                });
+        }
+
+        // Largest windows whose sums stay exact on 32 bits
+        constexpr long max_area_32 = 0xffffffffL / IMAGE_MAX_LEVEL;
+        constexpr long max_squares_area_32 =
+            max_area_32 / IMAGE_MAX_LEVEL;
+
+        long window_area(int radius)
+        {
+            return (2L * radius + 1) * (2L * radius + 1);
+        }
+    } // namespace
+
+    int otsu_threshold(const histogram_1d& hist)
+    {
+        double count = 0;
+        double sum = 0;
+        for (int level = 0; level < IMAGE_NB_LEVELS; level++)
+        {
+            count += hist.histogram[level];
+            sum += (double)level * hist.histogram[level];
+        }
+
+        // Between class variance, times count^2, for [0, t] and the rest:
+        // (sum * count_0 - sum_0 * count)^2 / (count_0 * count_1)
+        int best = 0;
+        double best_variance = -1;
+        double count_0 = 0;
+        double sum_0 = 0;
+        for (int t = 0; t < IMAGE_MAX_LEVEL; t++)
+        {
+            count_0 += hist.histogram[t];
+            sum_0 += (double)t * hist.histogram[t];
+            double count_1 = count - count_0;
+            if (count_0 == 0 || count_1 == 0)
+                continue;
+
+            double difference = sum * count_0 - sum_0 * count;
+            double variance = difference * difference / (count_0 * count_1);
+            if (variance > best_variance)
+            {
+                best = t;
+                best_variance = variance;
+            }
+        }
+        return best;
+    }
+
+    gray8_image* threshold(const gray8_image& image, int level)
+    {
+        auto result = new gray8_image(image.sx, image.sy);
+        parallel_rows(image.sy, [&](int begin, int end) {
+            const uint8_t* in = image.pixels + begin * image.sx;
+            uint8_t* out = result->pixels + begin * image.sx;
+            int n = (end - begin) * image.sx;
+
+            // Compares and selects whole vectors of bytes
+            for (int i = 0; i < n; i++)
+                out[i] = in[i] > level ? 255 : 0;
+        });
+        return result;
+    }
+
+    gray8_image* otsu_binarize(const gray8_image& image)
+    {
+        return threshold(image, otsu_threshold(gray_histogram(image)));
+    }
+
+    gray8_image* sauvola_binarize(const gray8_image& image, int radius,
+                                  float k, float range)
+    {
+        if (window_area(radius) <= max_squares_area_32)
+            return sauvola<uint32_t>(image, radius, k, range);
+        return sauvola<uint64_t>(image, radius, k, range);
+    }
+
+    gray8_image* bradley_binarize(const gray8_image& image, int radius,
+                                  float t)
+    {
+        if (window_area(radius) <= max_area_32)
+            return bradley<uint32_t>(image, radius, t);
+        return bradley<uint64_t>(image, radius, t);
+    }
+
+    bit_mask pack_mask(const gray8_image& mask)
+    {
+        bit_mask result;
+        result.sx = mask.sx;
+        result.sy = mask.sy;
+        result.stride = (mask.sx + 7) / 8;
+        result.bits.resize((std::size_t)result.stride * mask.sy);
+
+        parallel_rows(mask.sy, [&](int begin, int end) {
+            for (int y = begin; y < end; y++)
+            {
+                const uint8_t* in = mask.pixels + y * mask.sx;
+                uint8_t* out = result.bits.data() + y * result.stride;
+
+                int x = 0;
+                for (; x + 8 <= mask.sx; x += 8)
+                {
+                    uint8_t byte = 0;
+                    for (int bit = 0; bit < 8; bit++)
+                        byte |= (in[x + bit] != 0) << (7 - bit);
+                    out[x / 8] = byte;
+                }
+                if (x < mask.sx)
+                {
+                    uint8_t byte = 0;
+                    for (int bit = 0; x + bit < mask.sx; bit++)
+                        byte |= (in[x + bit] != 0) << (7 - bit);
+                    out[x / 8] = byte;
+                }
+            }
+        });
+
+        return result;
+    }
+} // namespace tifo
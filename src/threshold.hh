@@ -0,0 +1,64 @@
+#ifndef TIFO_PROJECT_THRESHOLD_HH
+#define TIFO_PROJECT_THRESHOLD_HH
+
+#include <vector>
+
+#include "histogram.hh"
+#include "image.hh"
+
+namespace tifo
+{
+    /*
+     * The binarizations return a new mask of the size of the image: 255
+     * for the pixels above their threshold (the paper of a scanned page),
+     * 0 for the others (the ink).
+     */
+
+    /**
+     * Otsu's threshold: the level t splitting the histogram in [0, t] and
+     * [t + 1, 255] with the largest variance between the two classes.
+     */
+    int otsu_threshold(const histogram_1d& hist);
+
+    gray8_image* threshold(const gray8_image& image, int level);
+    /** threshold at the Otsu level of the histogram of the image. */
+    gray8_image* otsu_binarize(const gray8_image& image);
+
+    /*
+     * Local thresholds over the (2 radius + 1)^2 window around each pixel,
+     * clipped to the image, from the integral images of bands of rows.
+     */
+
+    /**
+     * Sauvola: mean * (1 + k * (deviation / range - 1)), which lowers the
+     * threshold where the window is flat.
+     */
+    gray8_image* sauvola_binarize(const gray8_image& image, int radius,
+                                  float k = 0.2f, float range = 128);
+    /** Bradley: the pixels darker than mean * (1 - t) are ink. */
+    gray8_image* bradley_binarize(const gray8_image& image, int radius,
+                                  float t = 0.15f);
+
+    /**
+     * Mask of one bit per pixel, the first pixel of each row in the most
+     * significant bit of its first byte, as in PBM files.
+     */
+    struct bit_mask
+    {
+        int sx = 0;
+        int sy = 0;
+        /** Bytes per row. */
+        int stride = 0;
+        std::vector<uint8_t> bits;
+
+        bool at(int x, int y) const
+        {
+            return bits[y * stride + x / 8] & (0x80 >> (x % 8));
+        }
+    };
+
+    /** Sets the bits of the pixels which are not 0. */
+    bit_mask pack_mask(const gray8_image& mask);
+} // namespace tifo
+
+#endif //TIFO_PROJECT_THRESHOLD_HH